@@ -39,6 +39,7 @@ SOFTWARE.
  *  @section Functionality
  *  - Provides an OPC-UA server at TCP/IP port 16664.
  *  - Server configuration is loadad from file /nvram/cfg/opcua.xml
+ *    (another file can be given as the only command line argument)
  *  - The /dev/libera.strm0 is captured to obtain the measured data.
  *  - When enabled, all data from strm0 is sent out to an UDP output stream.
  *  - Access to device configuration parameters is handled with the MCI facility.
@@ -88,13 +89,22 @@ SOFTWARE.
  *
  */
 
+#define _GNU_SOURCE
+
 #include <unistd.h>
 #include <stdio.h>
 #include <fcntl.h>		     // for flags
 #include <sys/stat.h>        // for fstat()
+#include <sys/socket.h>      // for a unix socket as stream source
+#include <sys/un.h>
 #include <stdlib.h>		     // for exit()
+#include <stddef.h>          // for offsetof()
+#include <math.h>            // for isfinite()
 #include <signal.h>		     // for signal()
 #include <errno.h>		     // for error messages
+#include <time.h>            // for clock_gettime()
+#include <poll.h>            // for poll()
+#include <sys/eventfd.h>     // for eventfd()
 #include <pthread.h>         // for threads
 
 #include <netinet/udp.h>	 // declarations for udp header
@@ -106,33 +116,47 @@ SOFTWARE.
 
 #include "open62541.h"       // the OPC-UA library
 #include "libera_mci.h"      // the MCI access routines
+#include "libera_mirror.h"   // on-demand mirror of the MCI tree
+#include "libera_settings.h" // snapshots of the settings
 #include "libera_opcua.h"    // OPC-UA variable handling
+#include "libera_realtime.h" // real-time scheduling of the stream threads
+#include "libera_latency.h"  // latency histograms of the data path
+#include "libera_nodes.h"    // node IDs of the address space
+#include "libera_stream.h"   // data records and ring buffer
+#include "libera_sequence.h" // sequence check of the trigger counter
+#include "libera_udp.h"      // UDP output stream
 
 /***********************************/
 /* definitions for the data stream */
 /***********************************/
 
-#define BLOCKSIZE 64
-#define BUFFERSIZE 256		 // must be a multiple of 64
-
-// the data structure sent by the Libera instrument
-struct single_pass_data {
-   int32_t va;
-   int32_t vb;
-   int32_t vc;
-   int32_t vd;
-   int32_t sum;
-   int32_t q;
-   int32_t x;
-   int32_t y;
-   uint32_t trigger_cnt;
-   uint32_t bunch_cnt;
-   uint32_t status;
-   uint32_t mode;
-   int32_t R2;
-   int32_t R3;
-   uint64_t time;
-};
+// default and maximum size of the stream read buffer in records
+// a single read() can drain that many records from the driver
+#define READBUFFER_RECORDS 64
+#define READBUFFER_MAX_RECORDS 4096
+
+// the default configuration file
+#define CONFIG_FILE "/nvram/cfg/opcua.xml"
+
+// the default source of the data stream
+#define STREAM_DEVICE "/dev/libera.strm0"
+
+// default and maximum time without data before the source stream is reported stalled [ms]
+#define STREAM_STALL_MS 1000
+#define STREAM_MAX_STALL_MS 60000
+
+// maximum number of missed triggers per second tolerated before a StreamLossEvent is raised
+// the maximum is above any trigger rate of the device
+// without the loss property of <stream><input> no events are raised
+#define STREAM_MAX_LOSS_THRESHOLD 100000
+
+// the delay after read errors doubles from the minimum up to the maximum [ms]
+#define STREAM_ERROR_MIN_MS 10
+#define STREAM_ERROR_MAX_MS 1000
+
+// default and maximum rate of value updates published to the OPC-UA clients [Hz]
+#define PUBLISH_RATE 10
+#define PUBLISH_MAX_RATE 1000
 
 /***********************************/
 /* Server-related variables        */
@@ -142,28 +166,65 @@ struct single_pass_data {
 UA_Server *server;
 
 // primary storage of the current values
-static int32_t SP_va = 0;
-static int32_t SP_vb = 0;
-static int32_t SP_vc = 0;
-static int32_t SP_vd = 0;
-static double SP_charge = 0.0;
-static double SP_pos_x = 0.0;
-static double SP_pos_y = 0.0;
-static double SP_shape_q = 0.0;
-
-// error codes
-#define UDP_STREAM_CLOSED -1
-#define UDP_STREAM_NO_SOCKET -2
-#define UDP_STREAM_GOOD 1
+// all values of the latest shot are published together
+static ShotSnapshot SP_snapshot;
+// maximum number of updates of the Signals/SP variables per second
+static uint32_t PublishRate = PUBLISH_RATE;
+// the values of the last HistoryDepth shots
+static ShotHistory SP_history;
+static uint32_t HistoryDepth = HISTORY_DEPTH;
+
+// the optional mirror of the MCI tree
+static bool MirrorEnabled = false;
+static uint32_t MirrorTTL = MIRROR_TTL;
+static bool MirrorWritable = false;
+
+// the source of the data stream, the device, a FIFO, a file or a unix socket
+static char StreamDevice[108] = STREAM_DEVICE;
 
 // primary storage of the data streaming information
-static int32_t StreamSourceStatus = -1;
+static volatile int32_t StreamSourceStatus = STREAM_SOURCE_CLOSED;
+// time of the last record received (monotonic clock, ms)
+static volatile uint32_t StreamLastRecord = 0;
+// time without data before the stream is reported stalled
+static uint32_t StreamStallTime = STREAM_STALL_MS;
+// statistics of the source stream, written by the reader thread only
+static uint64_t SourceRecords = 0;
+static uint64_t SourceBytes = 0;
+// reads returning a size which is not a multiple of the record size
+static uint64_t SourcePartialReads = 0;
+static uint64_t StreamReadErrors = 0;
+// sequence check of the trigger counter, written by the reader thread only
+static SequenceCheck StreamSequence;
+// number of missed triggers per second which raises a StreamLossEvent
+static bool StreamLossCheck = false;
+static uint32_t StreamLossThreshold = 0;
+// signalled to wake up the stream reader for shutdown
+static int StreamStopFd = -1;
+// scheduling of the stream reader thread
+static RtThreadConfig ReaderThread = RT_THREAD_DEFAULT;
+// lock all pages of the process into memory
+static bool LockMemory = false;
+// variation of the latency between the record time stamps and their reception
+static RtJitter ArrivalJitter;
 static int32_t StreamError = -1;
+// the state of the UDP stream requested by the clients
 static bool StreamTransmit = false;
+// incremented with every write of Stream/Transmit, the UDP stage carries out the request
+static uint32_t TransmitRequests = 0;
 static uint32_t StreamSourceIP = 0;         // 10.66.67.20
 static uint32_t StreamSourcePort = 0;
 static uint32_t StreamTargetIP = 0;         // 10.66.67.1
 static uint32_t StreamTargetPort = 0;
+static int32_t StreamMode = UDP_MODE_RAW;
+static uint32_t StreamBatch = UDP_BATCH;
+static uint32_t StreamPacketRecords = 1;
+static uint32_t StreamLatency = UDP_LATENCY;
+
+// size of the read buffer for the input stream (number of records)
+static uint32_t StreamReadRecords = READBUFFER_RECORDS;
+// size of the ring buffer between the reader and the consumers (number of records)
+static uint32_t StreamRingRecords = RING_RECORDS;
 
 // the OPC-UA variables hosted by this server
 /*
@@ -172,6 +233,13 @@ static uint32_t StreamTargetPort = 0;
     Device
     |   Name
     |   SampleFreq
+    |   MciCacheHits
+    |   MciCacheMisses
+    |   MciConnected
+    |   MciReconnects
+    |   SaveSnapshot()
+    |   RestoreSnapshot()
+    |   ListSnapshots()
     Signals
     |   SP
     |   |   VA
@@ -182,15 +250,56 @@ static uint32_t StreamTargetPort = 0;
     |   |   PosX
     |   |   PosY
     |   |   ShapeQ
+    |   |   ReceiveTime
     |   MaxADC
+    |   History
+    |   |   VA
+    |   |   VB
+    |   |   VC
+    |   |   VD
+    |   |   Charge
+    |   |   PosX
+    |   |   PosY
+    |   |   ShapeQ
+    |   |   TriggerCnt
+    |   |   Time
     Stream
     |   StreamStatus
     |   Error
+    |   SourceIdle
+    |   ArrivalJitter
+    |   ArrivalJitterPeak
     |   SourceIP
     |   SourcePort
     |   TargetIP
     |   TargetPort
     |   Transmit
+    |   Mode
+    |   Batch
+    |   PacketRecords
+    |   Latency
+    |   Statistics
+    |   |   RecordsRead
+    |   |   RecordRate
+    |   |   BytesRead
+    |   |   ByteRate
+    |   |   PartialReads
+    |   |   ReadErrors
+    |   |   DroppedRecords
+    |   |   DropRate
+    |   |   TriggerGaps
+    |   |   MissedTriggers
+    |   |   MissedTriggerRate
+    |   |   Reordered
+    |   |   Duplicates
+    |   |   CounterResets
+    |   |   PacketsSent
+    |   |   PacketRate
+    |   |   BytesSent
+    |   |   SendRate
+    |   |   SendErrors
+    |   |   SendBlocked
+    |   |   SequenceEvents
     DSP
     |   Enable
     |   BunchThr1
@@ -212,54 +321,23 @@ static uint32_t StreamTargetPort = 0;
     |   OffsetY
     |   OffsetQ
     |   OffsetSum
+    |   ApplyCalibration()
     ClockInfo
+    Diagnostics
+    |   ResetLatency()
+    |   Read
+    |   |   Count
+    |   |   P50
+    |   |   P99
+    |   |   P999
+    |   |   Max
+    |   Decode
+    |   Enqueue
+    |   UdpSend
+    |   Publish
+    MCI (optional, contents created on demand)
 */
 
-// fixed node IDs
-#define LIBERA_DEVICE_ID 49000
-#define LIBERA_DEVNAME_ID 49100
-#define LIBERA_DEVFREQ_ID 49200
-#define LIBERA_SIGNALS_ID  50000
-#define LIBERA_SP_ID  50100
-#define LIBERA_VA_ID  50101
-#define LIBERA_VB_ID  50102
-#define LIBERA_VC_ID  50103
-#define LIBERA_VD_ID  50104
-#define LIBERA_CHARGE_ID  50110
-#define LIBERA_POSX_ID  50120
-#define LIBERA_POSY_ID  50130
-#define LIBERA_SHAPEQ_ID  50140
-#define LIBERA_MAXADC_ID  50200
-#define LIBERA_STREAM_ID 51000
-#define LIBERA_STREAMSTATUS_ID 51100
-#define LIBERA_STREAMERROR_ID 51110
-#define LIBERA_SOURCEIP_ID 51200
-#define LIBERA_SOURCEPORT_ID 51210
-#define LIBERA_TARGETIP_ID 51300
-#define LIBERA_TARGETPORT_ID 51310
-#define LIBERA_TRANSMIT_ID 51400
-#define LIBERA_DSP_ID 52000
-#define LIBERA_DSP_ENABLE_ID 52010
-#define LIBERA_DSP_THR1_ID 52020
-#define LIBERA_DSP_PRE_ID 52030
-#define LIBERA_DSP_POST1_ID 52040
-#define LIBERA_DSP_TIMEOUT_ID 52050
-#define LIBERA_DSP_AVERAGING_ID 52060
-#define LIBERA_CAL_ID 54000
-#define LIBERA_CAL_ATT_ID 54010
-#define LIBERA_CAL_KA_ID 54110
-#define LIBERA_CAL_KB_ID 54120
-#define LIBERA_CAL_KC_ID 54130
-#define LIBERA_CAL_KD_ID 54140
-#define LIBERA_CAL_LINX_ID 54210
-#define LIBERA_CAL_LINY_ID 54220
-#define LIBERA_CAL_LINQ_ID 54230
-#define LIBERA_CAL_LINS_ID 54240
-#define LIBERA_CAL_OFFX_ID 54310
-#define LIBERA_CAL_OFFY_ID 54320
-#define LIBERA_CAL_OFFQ_ID 54330
-#define LIBERA_CAL_OFFS_ID 54340
-
 // this variable is a flag for the running server
 // when set to false the server stops
 UA_Boolean running = true;
@@ -275,103 +353,172 @@ void Die(char *mess)
     exit(1);
 }
 
+// wake up the stream reader, it exits when running is false
+// this is async-signal-safe
+static void stopStream()
+{
+    uint64_t one = 1;
+    if (StreamStopFd >= 0)
+    {
+        ssize_t res = write(StreamStopFd, &one, sizeof(one));
+        (void)res;
+    }
+}
+
 // handle SIGINT und SIGTERM
 static void stopHandler(int signal)
 {
     printf("\nOpcUaServer : received ctrl-c\n");
     UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_SERVER, "received ctrl-c");
     running = 0;
+    stopStream();
+}
+
+// SIGUSR1 requests a dump of the latency histograms
+static volatile sig_atomic_t DumpLatency = 0;
+static void dumpHandler(int signal)
+{
+    DumpLatency = 1;
 }
 
 /***********************************/
-/* stream data handling            */
+/* latency of the data path        */
 /***********************************/
 /*
-    The main programm never acesses any of the streaming data structures.
-    All it does is fork off the readStream() thread. That one handles reading
-    the data frpm the Libera data stream and update the internal storage
-    of the OPC-UA Variables.
+    The latency of the records is measured from their hardware time stamp
+    to the stages of the data path
+    Read : the read() from the source stream has returned (reader thread)
+    Decode : the values have been decoded and stored (value stage)
+    Enqueue : the record has been added to an UDP packet (UDP stage)
+    UdpSend : the packet holding the record has been sent (UDP stage)
+    Publish : the values have been written to the OPC-UA variables (server thread)
+    Every histogram has a single writer, they are evaluated by the server thread
+    when the Diagnostics variables are read or on SIGUSR1.
+*/
 
-    When a client requestes an UDP data stream (by writing StreamTransmit=true)
-    the datasource write routine opens the output UDP stream.
-    If this goes without errors the readStream() thread now also
-    sends out any received data packet via UDP.
+enum { LATENCY_READ, LATENCY_DECODE, LATENCY_ENQUEUE, LATENCY_UDP, LATENCY_PUBLISH };
+static const char *latency_names[] = { "Read", "Decode", "Enqueue", "UdpSend", "Publish" };
+#define NUM_LATENCY_STAGES (sizeof(latency_names)/sizeof(latency_names[0]))
+static LatencyHistogram latency_hist[NUM_LATENCY_STAGES];
 
-    The UDP stream is closed again when a client requests that
-    or write errors occur.
-*/
+// the values of a stage published as variables
+enum { LATENCY_COUNT, LATENCY_P50, LATENCY_P99, LATENCY_P999, LATENCY_MAX };
+static const char *latency_values[] = { "Count", "P50", "P99", "P999", "Max" };
+#define NUM_LATENCY_VALUES (sizeof(latency_values)/sizeof(latency_values[0]))
 
-// header structure needed for checksum calculation
-struct pseudo_header
-{
-    u_int32_t source_address;
-    u_int32_t dest_address;
-    u_int8_t placeholder;
-    u_int8_t protocol;
-    u_int16_t udp_length;
-};
- 
-// data structures for the UDP output stream
-static int udp_socket;
-uint32_t udp_counter;		           // counter for transmitted UDP packets
-static struct sockaddr_in udp_server;
-static struct in_addr udp_source;	   // IP address of this BPM
-static struct in_addr udp_target;	   // IP address of the server the data is sent to
-
-// generic checksum calculation function
-unsigned short csum(unsigned short *ptr, int nbytes)
+// datasource read routine for the Diagnostics variables
+// the node context encodes stage and value as stage*NUM_LATENCY_VALUES+value
+UA_StatusCode readLatency(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean sourceTimeStamp,
+    const UA_NumericRange *range,
+    UA_DataValue *dataValue)
 {
-    register long sum;
-    unsigned short oddbyte;
-    register short answer;
-    sum=0;
-    while(nbytes>1) {
-        sum+=*ptr++;
-        nbytes-=2;
+    uintptr_t index = (uintptr_t)nodeContext;
+    LatencyStats stats;
+    latency_stats(&latency_hist[index / NUM_LATENCY_VALUES], &stats);
+    UA_Double value = 0.0;
+    switch (index % NUM_LATENCY_VALUES)
+    {
+        case LATENCY_COUNT :
+            UA_Variant_setScalarCopy(&dataValue->value, &stats.count, &UA_TYPES[UA_TYPES_UINT64]);
+            dataValue->hasValue = true;
+            return UA_STATUSCODE_GOOD;
+        case LATENCY_P50 : value = stats.p50; break;
+        case LATENCY_P99 : value = stats.p99; break;
+        case LATENCY_P999 : value = stats.p999; break;
+        case LATENCY_MAX : value = stats.max; break;
     }
-    if(nbytes==1) {
-        oddbyte=0;
-        *((unsigned char*)&oddbyte)=*(unsigned char*)ptr;
-        sum+=oddbyte;
+    UA_Variant_setScalarCopy(&dataValue->value, &value, &UA_TYPES[UA_TYPES_DOUBLE]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+// method restarting all latency histograms
+UA_StatusCode resetLatency(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output)
+{
+    for (size_t i=0; i<NUM_LATENCY_STAGES; i++)
+        latency_reset(&latency_hist[i]);
+    printf("OpcUaServer : latency histograms reset\n");
+    return UA_STATUSCODE_GOOD;
+}
+
+// print the latency statistics when requested by SIGUSR1
+// runs as a repeated callback on the server thread
+void dumpLatency(UA_Server *server, void *data)
+{
+    if (!DumpLatency)
+        return;
+    DumpLatency = 0;
+    printf("OpcUaServer : latency [us]     count        p50        p99       p999        max\n");
+    for (size_t i=0; i<NUM_LATENCY_STAGES; i++)
+    {
+        LatencyStats stats;
+        latency_stats(&latency_hist[i], &stats);
+        printf("OpcUaServer : %-10s %12llu %10.1f %10.1f %10.1f %10.1f\n", latency_names[i],
+            (unsigned long long)stats.count, stats.p50, stats.p99, stats.p999, stats.max);
     }
-    sum = (sum>>16)+(sum & 0xffff);
-    sum = sum + (sum>>16);
-    answer=(short)~sum;
-    return(answer);
+    fflush(stdout);
 }
 
+/***********************************/
+/* stream data handling            */
+/***********************************/
+/*
+    The main programm never acesses any of the streaming data structures.
+    All it does is fork off the readStream() thread and the consumer stage threads.
+    The readStream() thread only reads the data from the Libera data stream
+    and appends the records to the ring buffer. Every consumer stage
+    reads the records from the ring with its own read position, so a slow
+    consumer never delays reading the data stream. A consumer falling behind
+    by more than the ring size loses records which are counted as overruns.
+
+    The value stage updates the internal storage of the OPC-UA Variables.
+    When a client requestes an UDP data stream (by writing StreamTransmit=true)
+    the datasource write routine posts the request to the UDP stage.
+    The UDP stage alone owns the socket and the packet queue, it opens the
+    output UDP stream the next time it flushes. If this goes without errors
+    the UDP stage sends out any received data packet via UDP.
+
+    The UDP stream is closed again when a client requests that
+    or write errors occur. Every write of Stream/Transmit reopens the stream,
+    so changed settings of the stream get applied.
+*/
+
+// the UDP stage has to look for partially filled packets in time
+static void udpStageWait(int latency_ms);
+
 // open the output stream
+// called by the UDP stage only
 int openStreamUDP()
 {
-    int err = UDP_STREAM_GOOD;
-    printf("OpcUaServer : open UDP data stream\n");
-    udp_counter = 0;
-    // create a raw socket of type IPPROTO
-    udp_socket = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
-    if(udp_socket == -1)
-    {
-        printf("OpcUaServer : Failed to create raw socket. Maybe not permitted?\n");
-        err = UDP_STREAM_NO_SOCKET;
+    UdpConfig config = {
+        .mode = StreamMode,
+        .batch = StreamBatch,
+        .records = StreamPacketRecords,
+        .latency_ms = StreamLatency,
+        .source_ip = StreamSourceIP,
+        .source_port = StreamSourcePort,
+        .target_ip = StreamTargetIP,
+        .target_port = StreamTargetPort,
+        .latency = &latency_hist[LATENCY_UDP]
     };
-    // set addresses for the UDP output stream
-    udp_source.s_addr = StreamSourceIP;
-    udp_target.s_addr = StreamTargetIP;
-    // compile the server address
-    udp_server.sin_family = AF_INET;
-    udp_server.sin_addr.s_addr = udp_target.s_addr;
-    udp_server.sin_port = htons(StreamTargetPort);
-    printf("OpcUaServer : UDP source IP %s (%d) port %d\n",inet_ntoa(udp_source), udp_source.s_addr, StreamSourcePort);
-    printf("OpcUaServer : sending data to IP: %s (%d) port %d\n",inet_ntoa(udp_target), udp_target.s_addr, StreamTargetPort);
-    return err;
+    udpStageWait(config.latency_ms);
+    return udp_open(&config);
 }
 
 // close the output stream
 int closeStreamUDP()
 {
-    printf("OpcUaServer : close UDP data stream\n");
-    int status = close(udp_socket);
-    if (status==-1) printf("OpcUaServer : error closing the UDPsocket\n");
-    return UDP_STREAM_CLOSED;
+    return udp_close();
 }
 
 // special datasource write routine for the Stream/Transmit Variable
@@ -386,119 +533,749 @@ UA_StatusCode writeTransmit(
     if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN]) && (data->value.data != 0))
     {
         bool opcl = *(bool*)data->value.data;
-		StreamTransmit = opcl;		
-        if (opcl == true)
-            StreamError = openStreamUDP();
-        if (opcl == false)
-            StreamError = closeStreamUDP();
+        // the UDP stage opens or closes the stream, this thread must not touch it
+        __atomic_store_n(&StreamTransmit, opcl, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&TransmitRequests, 1, __ATOMIC_RELEASE);
         return UA_STATUSCODE_GOOD;
     }
     else
     {
-        StreamError = -2;
+        __atomic_store_n(&StreamError, -2, __ATOMIC_RELAXED);
 		printf("data error : writeTransmit\n");
         return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
     }
 }
 
+// store a written UInt32 value if it is within [min, max]
+static UA_StatusCode writeUInt32Range(const UA_DataValue *data, UA_UInt32 *dst, UA_UInt32 min, UA_UInt32 max)
+{
+    if (!data->hasValue || !UA_Variant_isScalar(&data->value) ||
+        (data->value.type != &UA_TYPES[UA_TYPES_UINT32]) || (data->value.data == NULL))
+        return UA_STATUSCODE_BADTYPEMISMATCH;
+    UA_UInt32 value = *(UA_UInt32 *)data->value.data;
+    if ((value < min) || (value > max))
+        return UA_STATUSCODE_BADOUTOFRANGE;
+    *dst = value;
+    return UA_STATUSCODE_GOOD;
+}
+
+// datasource write routine for the Stream/Mode variable
+// only UDP_MODE_RAW and UDP_MODE_DATAGRAM are accepted
+UA_StatusCode writeMode(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    const UA_NumericRange *range,
+    const UA_DataValue *data)
+{
+    if (!data->hasValue || !UA_Variant_isScalar(&data->value) ||
+        (data->value.type != &UA_TYPES[UA_TYPES_INT32]) || (data->value.data == NULL))
+        return UA_STATUSCODE_BADTYPEMISMATCH;
+    UA_Int32 mode = *(UA_Int32 *)data->value.data;
+    if ((mode != UDP_MODE_RAW) && (mode != UDP_MODE_DATAGRAM))
+        return UA_STATUSCODE_BADOUTOFRANGE;
+    StreamMode = mode;
+    return UA_STATUSCODE_GOOD;
+}
+
+// datasource write routine for the Stream/Batch variable
+UA_StatusCode writeBatch(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    const UA_NumericRange *range,
+    const UA_DataValue *data)
+{
+    return writeUInt32Range(data, &StreamBatch, 1, UDP_MAX_BATCH);
+}
+
+// datasource write routine for the Stream/PacketRecords variable
+UA_StatusCode writePacketRecords(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    const UA_NumericRange *range,
+    const UA_DataValue *data)
+{
+    return writeUInt32Range(data, &StreamPacketRecords, 1, UDP_MAX_RECORDS);
+}
+
+// datasource write routine for the Stream/Latency variable
+// the value is applied when the stream is opened the next time
+UA_StatusCode writeLatency(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    const UA_NumericRange *range,
+    const UA_DataValue *data)
+{
+    return writeUInt32Range(data, &StreamLatency, 0, UDP_MAX_LATENCY);
+}
+
+/***********************************/
+/* publishing the shot values      */
+/***********************************/
+/*
+    The Signals/SP variables are ordinary variable nodes. Their values are
+    written by publishValues() which runs as a repeated callback on the
+    server thread (the server is not thread-safe, so no other thread may
+    write the nodes). Whenever a new shot has arrived since the last call
+    all values of that shot are written at once with the hardware time stamp
+    of the record as source timestamp, so clients can correlate the shots
+    of different devices. The time of reception is published separately
+    as ReceiveTime. Monitored items thus get change-driven notifications
+    and the publishing rate is limited to PublishRate updates per second.
+*/
+
+// table of the published variables
+typedef struct {
+    UA_UInt32 id;           // node ID in namespace 1
+    size_t offset;          // offset of the value within ShotData
+    int type;               // index into UA_TYPES
+} PublishedValue;
+
+static const PublishedValue published_values[] = {
+    { LIBERA_VA_ID, offsetof(ShotData, va), UA_TYPES_INT32 },
+    { LIBERA_VB_ID, offsetof(ShotData, vb), UA_TYPES_INT32 },
+    { LIBERA_VC_ID, offsetof(ShotData, vc), UA_TYPES_INT32 },
+    { LIBERA_VD_ID, offsetof(ShotData, vd), UA_TYPES_INT32 },
+    { LIBERA_CHARGE_ID, offsetof(ShotData, charge), UA_TYPES_DOUBLE },
+    { LIBERA_POSX_ID, offsetof(ShotData, pos_x), UA_TYPES_DOUBLE },
+    { LIBERA_POSY_ID, offsetof(ShotData, pos_y), UA_TYPES_DOUBLE },
+    { LIBERA_SHAPEQ_ID, offsetof(ShotData, shape_q), UA_TYPES_DOUBLE },
+    { LIBERA_RECEIVETIME_ID, offsetof(ShotData, received), UA_TYPES_DATETIME }
+};
+#define NUM_PUBLISHED_VALUES (sizeof(published_values)/sizeof(published_values[0]))
+
+// repeated callback on the server thread
+void publishValues(UA_Server *server, void *data)
+{
+    static uint32_t published = 0;
+    ShotData shot;
+    // nothing to do if no new shot has arrived
+    if (snapshot_sequence(&SP_snapshot) == published)
+        return;
+    published = snapshot_read(&SP_snapshot, &shot);
+    for (size_t i=0; i<NUM_PUBLISHED_VALUES; i++)
+    {
+        UA_DataValue value;
+        UA_DataValue_init(&value);
+        // the variant points into the local copy, writeDataValue() copies it
+        UA_Variant_setScalar(&value.value, (char*)&shot + published_values[i].offset,
+                             &UA_TYPES[published_values[i].type]);
+        value.hasValue = true;
+        value.sourceTimestamp = shot.timestamp;
+        value.hasSourceTimestamp = true;
+        UA_Server_writeDataValue(server, UA_NODEID_NUMERIC(1, published_values[i].id), value);
+    }
+    latency_add(&latency_hist[LATENCY_PUBLISH], shot.time, latency_now());
+}
+
+/***********************************/
+/* shot history arrays             */
+/***********************************/
+/*
+    The Signals/History variables are arrays holding the values of the
+    last HistoryDepth shots, the oldest shot first. They are datasource
+    variables read directly from the history, a NumericRange given by the
+    client is handled here, so only the requested slice is copied.
+*/
+
+typedef struct {
+    UA_UInt32 id;           // node ID in namespace 1
+    int signal;             // index of the signal in the history
+    int type;               // index into UA_TYPES
+    char *name;
+    char *description;
+} HistoryVariable;
+
+static const HistoryVariable history_variables[] = {
+    { LIBERA_HIST_VA_ID, HISTORY_VA, UA_TYPES_INT32, "VA", "channel A raw signal history" },
+    { LIBERA_HIST_VB_ID, HISTORY_VB, UA_TYPES_INT32, "VB", "channel B raw signal history" },
+    { LIBERA_HIST_VC_ID, HISTORY_VC, UA_TYPES_INT32, "VC", "channel C raw signal history" },
+    { LIBERA_HIST_VD_ID, HISTORY_VD, UA_TYPES_INT32, "VD", "channel D raw signal history" },
+    { LIBERA_HIST_CHARGE_ID, HISTORY_CHARGE, UA_TYPES_DOUBLE, "Charge", "bunch charge history in pC" },
+    { LIBERA_HIST_POSX_ID, HISTORY_POSX, UA_TYPES_DOUBLE, "PosX", "position X history in mm" },
+    { LIBERA_HIST_POSY_ID, HISTORY_POSY, UA_TYPES_DOUBLE, "PosY", "position Y history in mm" },
+    { LIBERA_HIST_SHAPEQ_ID, HISTORY_SHAPEQ, UA_TYPES_DOUBLE, "ShapeQ", "shape parameter q history" },
+    { LIBERA_HIST_TRIGGERCNT_ID, HISTORY_TRIGGERCNT, UA_TYPES_UINT32, "TriggerCnt", "trigger counter history" },
+    { LIBERA_HIST_TIME_ID, HISTORY_TIME, UA_TYPES_DATETIME, "Time", "hardware time stamp history" }
+};
+#define NUM_HISTORY_VARIABLES (sizeof(history_variables)/sizeof(history_variables[0]))
+
+// datasource read routine for the Signals/History variables
+// the nodeContext points to the HistoryVariable entry
+UA_StatusCode readHistory(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean sourceTimeStamp,
+    const UA_NumericRange *range,
+    UA_DataValue *dataValue)
+{
+    const HistoryVariable *var = (const HistoryVariable *)nodeContext;
+    const UA_DataType *type = &UA_TYPES[var->type];
+    uint32_t first = 0;
+    uint32_t n = HistoryDepth;
+    if (range != NULL)
+    {
+        if ((range->dimensionsSize != 1) || (range->dimensions[0].min > range->dimensions[0].max))
+            return UA_STATUSCODE_BADINDEXRANGEINVALID;
+        first = range->dimensions[0].min;
+        if (first >= HistoryDepth)
+            return UA_STATUSCODE_BADINDEXRANGENODATA;
+        if (range->dimensions[0].max - first < HistoryDepth)
+            n = range->dimensions[0].max - first + 1;
+    }
+    if (n > HistoryDepth - first)
+        n = HistoryDepth - first;
+    void *values = UA_Array_new(n, type);
+    if (values == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    n = history_read(&SP_history, var->signal, first, n, values);
+    if ((range != NULL) && (n == 0))
+    {
+        UA_Array_delete(values, 0, type);
+        return UA_STATUSCODE_BADINDEXRANGENODATA;
+    }
+    // the array may have been allocated larger, only the first n elements are valid
+    UA_Variant_setArray(&dataValue->value, values, n, type);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+// the parameters set by the Calibration/ApplyCalibration method in the order of its arguments
+// the first are scaling factors which have to be positive, the rest are offsets
+static const UA_UInt32 calibration_ids[] = {
+    LIBERA_CAL_KA_ID, LIBERA_CAL_KB_ID, LIBERA_CAL_KC_ID, LIBERA_CAL_KD_ID,
+    LIBERA_CAL_LINX_ID, LIBERA_CAL_LINY_ID, LIBERA_CAL_LINQ_ID, LIBERA_CAL_LINS_ID,
+    LIBERA_CAL_OFFX_ID, LIBERA_CAL_OFFY_ID, LIBERA_CAL_OFFQ_ID, LIBERA_CAL_OFFS_ID
+};
+#define NUM_CALIBRATION_PARAMS (sizeof(calibration_ids)/sizeof(calibration_ids[0]))
+#define NUM_CALIBRATION_FACTORS 8
+static const MciParamInfo *calibration_params[NUM_CALIBRATION_PARAMS];
+
+// maximum time to wait for the calibration to be written and verified [ms]
+#define CALIBRATION_TIMEOUT 5000
+
+// method writing the complete calibration with one MCI job
+// the output is the status of every parameter : Good if written and read back unchanged
+UA_StatusCode applyCalibration(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output)
+{
+    UA_StatusCode status[NUM_CALIBRATION_PARAMS];
+    UA_StatusCode res = UA_STATUSCODE_GOOD;
+    if (inputSize != NUM_CALIBRATION_PARAMS)
+        return UA_STATUSCODE_BADARGUMENTSMISSING;
+    // validate the complete set before anything is written
+    for (size_t i=0; i<NUM_CALIBRATION_PARAMS; i++)
+    {
+        status[i] = UA_STATUSCODE_GOOD;
+        if (!UA_Variant_hasScalarType(&input[i], &UA_TYPES[UA_TYPES_DOUBLE]))
+            status[i] = UA_STATUSCODE_BADTYPEMISMATCH;
+        else
+        {
+            UA_Double value = *(UA_Double *)input[i].data;
+            if (!isfinite(value) || ((i < NUM_CALIBRATION_FACTORS) && (value <= 0.0)))
+                status[i] = UA_STATUSCODE_BADOUTOFRANGE;
+        }
+        if (status[i] != UA_STATUSCODE_GOOD)
+            res = UA_STATUSCODE_BADINVALIDARGUMENT;
+    }
+    if (res == UA_STATUSCODE_GOOD)
+        res = mci_write_set(NUM_CALIBRATION_PARAMS, calibration_params, input, status, CALIBRATION_TIMEOUT);
+    if (res != UA_STATUSCODE_GOOD)
+        printf("OpcUaServer : ApplyCalibration failed %8x\n", res);
+    UA_Variant_setArrayCopy(&output[0], status, NUM_CALIBRATION_PARAMS, &UA_TYPES[UA_TYPES_STATUSCODE]);
+    return res;
+}
+
+// the ring buffer between the stream reader and the consumer stages
+static StreamRing stream_ring;
+
+// longest time a consumer stage waits for new records [ms]
+#define STAGE_WAIT_MS 100
+
+// a consumer stage of the data stream
+// every stage runs in its own thread and reads all records from the ring
+typedef struct {
+    const char *name;
+    RingReader reader;
+    void (*process)(const struct single_pass_data *record);
+    // optional, called whenever all available records have been processed
+    // and at least every wait_ms milliseconds
+    void (*flush)(void);
+    int wait_ms;
+    // scheduling of the stage thread
+    RtThreadConfig rt;
+    pthread_t tid;
+} StreamStage;
+
+// convert the hardware time stamp of a record [ns since the unix epoch] into an UA_DateTime
+// records without a valid time stamp (timing not synchronized) get the receive time
+UA_DateTime recordTime(uint64_t time, UA_DateTime received)
+{
+    if (time == 0)
+        return received;
+    return UA_DATETIME_UNIX_EPOCH + (UA_DateTime)(time / 100);
+}
+
+// value stage : update the storage of the OPC-UA variables
+void processValues(const struct single_pass_data *record)
+{
+    ShotData shot;
+    shot_decode(record, &shot);
+    shot.received = UA_DateTime_now();
+    shot.timestamp = recordTime(shot.time, shot.received);
+    snapshot_write(&SP_snapshot, &shot);
+    history_write(&SP_history, &shot);
+    latency_add(&latency_hist[LATENCY_DECODE], record->time, latency_now());
+}
+
+// the UDP stream state owned by the UDP stage
+static bool UdpOpen = false;
+static uint32_t TransmitApplied = 0;
+
+// UDP stage : carry out the last request posted by writeTransmit()
+static void applyTransmit()
+{
+    uint32_t request = __atomic_load_n(&TransmitRequests, __ATOMIC_ACQUIRE);
+    if (request == TransmitApplied)
+        return;
+    TransmitApplied = request;
+    if (UdpOpen)
+    {
+        closeStreamUDP();
+        UdpOpen = false;
+    }
+    int32_t error = UDP_STREAM_CLOSED;
+    if (__atomic_load_n(&StreamTransmit, __ATOMIC_RELAXED))
+    {
+        error = openStreamUDP();
+        UdpOpen = (error == UDP_STREAM_GOOD);
+        // a failed open is not retried until it is requested again
+        if (!UdpOpen)
+            __atomic_store_n(&StreamTransmit, false, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&StreamError, error, __ATOMIC_RELAXED);
+}
+
+// UDP stage : close the stream after a send error
+static void failUDP()
+{
+    fprintf(stderr, "OpcUaServer : error sending UDP data stream\n");
+    closeStreamUDP();
+    UdpOpen = false;
+    __atomic_store_n(&StreamTransmit, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&StreamError, UDP_STREAM_SEND_ERROR, __ATOMIC_RELAXED);
+}
+
+// UDP stage : if requested write packet to UDP stream
+void processUDP(const struct single_pass_data *record)
+{
+    if (UdpOpen)
+    {
+        latency_add(&latency_hist[LATENCY_ENQUEUE], record->time, latency_now());
+        if (udp_send(record) != UDP_STREAM_GOOD)
+            failUDP();
+    }
+}
+
+// UDP stage : open or close the stream as requested, send the queued packets
+// when the ring has been drained and partially filled packets when they have been waiting too long
+void flushUDP()
+{
+    applyTransmit();
+    if (UdpOpen)
+        if (udp_flush() != UDP_STREAM_GOOD)
+            failUDP();
+}
+
+enum { STAGE_VALUES, STAGE_UDP };
+static StreamStage stream_stages[] = {
+    [STAGE_VALUES] = { .name = "values", .process = processValues, .wait_ms = STAGE_WAIT_MS, .rt = RT_THREAD_DEFAULT },
+    [STAGE_UDP] = { .name = "UDP", .process = processUDP, .flush = flushUDP, .wait_ms = STAGE_WAIT_MS, .rt = RT_THREAD_DEFAULT }
+};
+#define NUM_STREAM_STAGES (sizeof(stream_stages)/sizeof(StreamStage))
+
+// the UDP stage has to look for partially filled packets in time
+// called by the UDP stage when it opens the stream, the wait is read in every loop
+static void udpStageWait(int latency_ms)
+{
+    int wait = STAGE_WAIT_MS;
+    if ((latency_ms > 0) && (latency_ms < wait))
+        wait = latency_ms;
+    __atomic_store_n(&stream_stages[STAGE_UDP].wait_ms, wait, __ATOMIC_RELAXED);
+}
+
+// the thread function of a consumer stage
+void* consumeStream(void *arg)
+{
+    StreamStage *stage = (StreamStage *)arg;
+    struct single_pass_data record;
+    while (running)
+    {
+        if (ring_wait(&stage->reader, __atomic_load_n(&stage->wait_ms, __ATOMIC_RELAXED)))
+            while (ring_read(&stage->reader, &record))
+                stage->process(&record);
+        if (stage->flush != NULL)
+            stage->flush();
+    };
+    printf("OpcUaServer : %s stage exit, %llu records, %llu overruns\n", stage->name,
+        (unsigned long long)stage->reader.records, (unsigned long long)stage->reader.overruns);
+    pthread_exit(NULL);
+}
+
+// the monotonic clock in ms, wrapping around after 49 days
+// differences are correct as long as they are computed as uint32_t
+static uint32_t stream_now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+// datasource read routine for the Stream/SourceIdle variable
+// the time since the last record was received [ms]
+UA_StatusCode readSourceIdle(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean sourceTimeStamp,
+    const UA_NumericRange *range,
+    UA_DataValue *dataValue)
+{
+    UA_UInt32 idle = stream_now_ms() - StreamLastRecord;
+    UA_Variant_setScalarCopy(&dataValue->value, &idle, &UA_TYPES[UA_TYPES_UINT32]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+// datasource read routine for the Stream/ArrivalJitter and ArrivalJitterPeak variables [us]
+// the node context selects the value (0 = RMS, 1 = peak-to-peak)
+UA_StatusCode readJitter(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean sourceTimeStamp,
+    const UA_NumericRange *range,
+    UA_DataValue *dataValue)
+{
+    UA_Double rms, peak;
+    jitter_get(&ArrivalJitter, &rms, &peak);
+    UA_Variant_setScalarCopy(&dataValue->value, (nodeContext == NULL) ? &rms : &peak, &UA_TYPES[UA_TYPES_DOUBLE]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+// the counters published in the Stream/Statistics folder
+/*
+    The counters are read by the server thread whenever a variable is read.
+    Once per second updateStatistics() takes a sample of all counters and
+    computes their rates from the difference to the previous sample.
+    Rates are published only for the counters having a rate name.
+*/
+enum {
+    STAT_RECORDS, STAT_BYTES, STAT_PARTIAL_READS, STAT_READ_ERRORS, STAT_DROPPED,
+    STAT_TRIGGER_GAPS, STAT_MISSED_TRIGGERS, STAT_REORDERED, STAT_DUPLICATES, STAT_COUNTER_RESETS,
+    STAT_PACKETS, STAT_WIRE_BYTES, STAT_SEND_ERRORS, STAT_SEND_BLOCKED,
+    NUM_STREAM_STATISTICS
+};
+typedef struct {
+    const char *name;
+    const char *description;
+    const char *rate_name;
+    const char *rate_description;
+} StatisticsVariable;
+static const StatisticsVariable statistics_variables[NUM_STREAM_STATISTICS] = {
+    [STAT_RECORDS] = { "RecordsRead", "records read from the source stream",
+        "RecordRate", "records read per second" },
+    [STAT_BYTES] = { "BytesRead", "bytes read from the source stream",
+        "ByteRate", "bytes read per second" },
+    [STAT_PARTIAL_READS] = { "PartialReads", "reads returning a size which is not a multiple of the record size", NULL, NULL },
+    [STAT_READ_ERRORS] = { "ReadErrors", "failed reads from the source stream", NULL, NULL },
+    [STAT_DROPPED] = { "DroppedRecords", "records lost by consumer stages falling behind (sum over all stages)",
+        "DropRate", "records dropped per second" },
+    [STAT_TRIGGER_GAPS] = { "TriggerGaps", "discontinuities of the trigger counter of the records", NULL, NULL },
+    [STAT_MISSED_TRIGGERS] = { "MissedTriggers", "trigger counts missing in the gaps and not arrived late",
+        "MissedTriggerRate", "triggers missed per second" },
+    [STAT_REORDERED] = { "Reordered", "records which arrived after a later trigger count", NULL, NULL },
+    [STAT_DUPLICATES] = { "Duplicates", "records repeating a trigger count already received", NULL, NULL },
+    [STAT_COUNTER_RESETS] = { "CounterResets", "jumps of the trigger counter taken as a restart of the timing", NULL, NULL },
+    [STAT_PACKETS] = { "PacketsSent", "UDP packets sent",
+        "PacketRate", "UDP packets sent per second" },
+    [STAT_WIRE_BYTES] = { "BytesSent", "bytes sent on the wire including IP and UDP headers",
+        "SendRate", "bytes sent on the wire per second" },
+    [STAT_SEND_ERRORS] = { "SendErrors", "failed UDP send calls, the stream is closed after them", NULL, NULL },
+    [STAT_SEND_BLOCKED] = { "SendBlocked", "UDP packets dropped because the socket buffer was full", NULL, NULL }
+};
+static uint64_t statistics_last[NUM_STREAM_STATISTICS];
+static UA_Double statistics_rate[NUM_STREAM_STATISTICS];
+static uint32_t statistics_time;
+
+// read the present values of all counters
+static void statistics_sample(uint64_t *values)
+{
+    values[STAT_RECORDS] = counter_get(&SourceRecords);
+    values[STAT_BYTES] = counter_get(&SourceBytes);
+    values[STAT_PARTIAL_READS] = counter_get(&SourcePartialReads);
+    values[STAT_READ_ERRORS] = counter_get(&StreamReadErrors);
+    values[STAT_DROPPED] = 0;
+    for (size_t i=0; i<NUM_STREAM_STAGES; i++)
+        values[STAT_DROPPED] += counter_get(&stream_stages[i].reader.overruns);
+    values[STAT_TRIGGER_GAPS] = counter_get(&StreamSequence.gaps);
+    values[STAT_MISSED_TRIGGERS] = counter_get(&StreamSequence.missed);
+    values[STAT_REORDERED] = counter_get(&StreamSequence.reordered);
+    values[STAT_DUPLICATES] = counter_get(&StreamSequence.duplicates);
+    values[STAT_COUNTER_RESETS] = counter_get(&StreamSequence.resets);
+    values[STAT_PACKETS] = counter_get(&udp_stats.packets);
+    values[STAT_WIRE_BYTES] = counter_get(&udp_stats.bytes);
+    values[STAT_SEND_ERRORS] = counter_get(&udp_stats.errors);
+    values[STAT_SEND_BLOCKED] = counter_get(&udp_stats.blocked);
+}
+
+// the type of the event raised when too many triggers have been missed
+static UA_NodeId StreamLossEventType;
+
+// raise a StreamLossEvent reporting the number of triggers missed during the last interval
+static void raiseLossEvent(UA_Server *server, int64_t missed)
+{
+    char text[80];
+    snprintf(text, sizeof(text), "%lld triggers missed during the last second", (long long)missed);
+    printf("OpcUaServer : %s\n", text);
+#ifdef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+    UA_NodeId eventId;
+    if (UA_Server_createEvent(server, StreamLossEventType, &eventId) != UA_STATUSCODE_GOOD)
+        return;
+    UA_DateTime time = UA_DateTime_now();
+    UA_UInt16 severity = 500;
+    UA_LocalizedText message = UA_LOCALIZEDTEXT("en_US", text);
+    UA_String source = UA_STRING("Stream");
+    UA_Server_writeObjectProperty_scalar(server, eventId, UA_QUALIFIEDNAME(0, "Time"), &time, &UA_TYPES[UA_TYPES_DATETIME]);
+    UA_Server_writeObjectProperty_scalar(server, eventId, UA_QUALIFIEDNAME(0, "Severity"), &severity, &UA_TYPES[UA_TYPES_UINT16]);
+    UA_Server_writeObjectProperty_scalar(server, eventId, UA_QUALIFIEDNAME(0, "Message"), &message, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+    UA_Server_writeObjectProperty_scalar(server, eventId, UA_QUALIFIEDNAME(0, "SourceName"), &source, &UA_TYPES[UA_TYPES_STRING]);
+    UA_Server_triggerEvent(server, eventId, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER), NULL, true);
+#endif
+}
+
+// compute the rates of all counters and check the loss of triggers
+// runs once per second as a repeated callback on the server thread
+void updateStatistics(UA_Server *server, void *data)
+{
+    uint64_t values[NUM_STREAM_STATISTICS];
+    uint32_t now = stream_now_ms();
+    uint32_t elapsed = now - statistics_time;
+    statistics_sample(values);
+    // the missed triggers decrease when records arrive late
+    if (elapsed > 0)
+        for (size_t i=0; i<NUM_STREAM_STATISTICS; i++)
+            statistics_rate[i] = (UA_Double)(int64_t)(values[i] - statistics_last[i]) * 1000.0 / elapsed;
+    int64_t missed = (int64_t)(values[STAT_MISSED_TRIGGERS] - statistics_last[STAT_MISSED_TRIGGERS]);
+    if (StreamLossCheck && (missed > (int64_t)StreamLossThreshold))
+        raiseLossEvent(server, missed);
+    memcpy(statistics_last, values, sizeof(statistics_last));
+    statistics_time = now;
+}
+
+// datasource read routine for the Stream/Statistics variables
+// the node context is the index of the counter, rates follow after all counters
+UA_StatusCode readStatistics(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean sourceTimeStamp,
+    const UA_NumericRange *range,
+    UA_DataValue *dataValue)
+{
+    uintptr_t index = (uintptr_t)nodeContext;
+    if (index < NUM_STREAM_STATISTICS)
+    {
+        uint64_t values[NUM_STREAM_STATISTICS];
+        statistics_sample(values);
+        UA_UInt64 value = values[index];
+        UA_Variant_setScalarCopy(&dataValue->value, &value, &UA_TYPES[UA_TYPES_UINT64]);
+    }
+    else
+        UA_Variant_setScalarCopy(&dataValue->value, &statistics_rate[index - NUM_STREAM_STATISTICS], &UA_TYPES[UA_TYPES_DOUBLE]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+// datasource read routine for the Stream/Statistics/SequenceEvents variable
+// the recent events of the trigger counter sequence as text, the newest first
+UA_StatusCode readSequenceEvents(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean sourceTimeStamp,
+    const UA_NumericRange *range,
+    UA_DataValue *dataValue)
+{
+    SequenceEvent events[SEQUENCE_EVENTS];
+    char lines[SEQUENCE_EVENTS][120];
+    UA_String text[SEQUENCE_EVENTS];
+    uint32_t n = sequence_events(&StreamSequence, events, SEQUENCE_EVENTS);
+    for (uint32_t i=0; i<n; i++)
+    {
+        char *line = lines[i];
+        char date[32];
+        time_t sec = (time_t)(events[i].time / 1000000000);
+        struct tm tm;
+        gmtime_r(&sec, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+        int len = snprintf(line, sizeof(lines[i]), "%s.%06u UTC %s expected %u received %u",
+            date, (unsigned)(events[i].time % 1000000000 / 1000), sequence_kind_name(events[i].kind),
+            events[i].expected, events[i].received);
+        if (events[i].kind == SEQUENCE_GAP)
+            snprintf(line + len, sizeof(lines[i]) - len, " missed %u", events[i].missed);
+        text[i] = UA_STRING(line);
+    }
+    UA_Variant_setArrayCopy(&dataValue->value, text, n, &UA_TYPES[UA_TYPES_STRING]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+// wait for the shutdown request at most timeout_ms
+static void stream_sleep(int timeout_ms)
+{
+    struct pollfd stop = { .fd = StreamStopFd, .events = POLLIN };
+    poll(&stop, 1, timeout_ms);
+}
+
 // read the data from the input stream
-// when requested copy the data to the output UDP stream
-// TODO: if the stream never has any data, the thread blocks
+// and append all records to the ring buffer
+/*
+    The reader waits with poll() for data on the stream and for the shutdown
+    eventfd, so it exits as soon as the server is stopped, even if the stream
+    does not deliver any data. When no record has arrived for StreamStallTime
+    the StreamStatus is set to STREAM_SOURCE_STALLED, Stream/SourceIdle always
+    holds the time since the last record. After read errors the reader waits
+    before the next attempt, the delay doubles with every consecutive error.
+    The reader counts the records and bytes read and checks the sequence of
+    the trigger counter, its gaps reveal shots lost before they reached the server.
+
+    One read() may return any number of records, limited by the size of the
+    read buffer. All complete records are written to the ring in order
+    and the consumers are notified once per read(). Should the driver
+    ever return a partial record, the incomplete tail is moved to the start
+    of the buffer and completed by the next read().
+*/
 void* readStream(void *arg)
 {
-    long int counter = 0;
-    char readbuffer[BUFFERSIZE];        // buffer for reading from the datat stream
-    struct single_pass_data *record;    // pointer to one data block
+    size_t fill = 0;                    // number of valid bytes in the read buffer
+    size_t buffersize = (size_t)StreamReadRecords * BLOCKSIZE;
+    int backoff = 0;                    // delay after the last read error [ms]
     
     int fd = *((int *)arg);
     printf("OpcUaServer : reading from fd=%d\n",fd);
-    // the record points just to the first block in the read buffer
-    record = (struct single_pass_data *) readbuffer;
-
-    struct pseudo_header psh;	        // header for checksum calculation
-    char pseudogram[BUFFERSIZE];	    // datagram for checksum calculation
-    char udp_buffer[BUFFERSIZE];	    // UDP packet buffer
-    // the IP header is at the beginning of the buffer
-    struct iphdr *iph = (struct iphdr *) udp_buffer;
-    // the UDP header follows after the IP header
-    struct udphdr *udph = (struct udphdr *) (udp_buffer + sizeof(struct iphdr));
-    // pointer to the payload within the data buffer
-    char *databuffer = (char *)(udp_buffer + sizeof(struct iphdr) + sizeof(struct udphdr));
-    int PAYLOADSIZE = BUFFERSIZE - sizeof(struct iphdr) - sizeof (struct udphdr);
-    if (BLOCKSIZE>PAYLOADSIZE)
-        Die("Insufficient buffer size\n");
-
+    // buffer for reading from the data stream
+    char *readbuffer = malloc(buffersize);
+    if (readbuffer == NULL)
+        Die("Failed to allocate stream read buffer\n");
+    printf("OpcUaServer : read buffer holds %d records\n", StreamReadRecords);
+
+    struct pollfd fds[2] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = StreamStopFd, .events = POLLIN }
+    };
+    StreamLastRecord = stream_now_ms();
+    StreamSourceStatus = STREAM_SOURCE_GOOD;
     while (running)
     {
-        int bytes_read = read(fd, readbuffer, BUFFERSIZE);
-        // handle read errors
-        if (-1 == bytes_read)
+        // wait until the stream is due to be reported stalled
+        uint32_t idle = stream_now_ms() - StreamLastRecord;
+        int timeout = (idle < StreamStallTime) ? (int)(StreamStallTime - idle) : (int)StreamStallTime;
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0)
         {
-            int errsv=errno;
-            fprintf(stderr, "OpcUaServer : read() from data stream");
-            // usleep(100000);
-            sleep(0.1);
-        };
-        // handle proper data blocks
-        if (BLOCKSIZE==bytes_read)
+            if (errno != EINTR)
+            {
+                perror("OpcUaServer : poll() on data stream");
+                stream_sleep(STREAM_ERROR_MAX_MS);
+            }
+            continue;
+        }
+        if (fds[1].revents != 0)
+            break;
+        if (ready == 0)
         {
-            counter++;
-            SP_va = record->va;
-            SP_vb = record->vb;
-            SP_vc = record->vc;
-            SP_vd = record->vd;
-            SP_pos_x = 1.e-6 * record->x;
-            SP_pos_y = 1.e-6 * record->y;
-            SP_charge = 0.0001 * record->sum;
-            SP_shape_q = 1.e-6 * record->q;
-            // if requested write packet to UDP stream
-            if (StreamTransmit && (StreamError == UDP_STREAM_GOOD))
+            if ((StreamSourceStatus == STREAM_SOURCE_GOOD) &&
+                ((uint32_t)(stream_now_ms() - StreamLastRecord) >= StreamStallTime))
             {
-                udp_counter++;
-                // clear the packet buffer
-                memset(udp_buffer, 0, BUFFERSIZE);
-                // fill in the data
-                memcpy(databuffer, readbuffer, BLOCKSIZE);
-                // fill in the IP Header
-                iph->ihl = 5;
-                iph->version = 4;
-                iph->tos = 0;
-                iph->tot_len = sizeof (struct iphdr) + sizeof (struct udphdr) + BLOCKSIZE;
-                iph->id = udp_counter;               // Id of this packet
-                iph->frag_off = 0;
-                iph->ttl = 255;
-                iph->protocol = IPPROTO_UDP;
-                iph->check = 0;			             // set to 0 before calculating checksum
-                iph->saddr = udp_source.s_addr;      // spoof the source IP address
-                iph->daddr = udp_target.s_addr;      // receiver IP address
-                // IP checksum
-                iph->check = csum ((unsigned short *) udp_buffer, iph->tot_len);
-                // UDP header
-                udph->source = htons (StreamSourcePort);
-                udph->dest = htons (StreamTargetPort);
-                udph->len = htons(8 + BLOCKSIZE);    // tcp header size
-                udph->check = 0;                     // leave checksum 0 now, filled later from pseudo header
-                // now compute the UDP checksum using the pseudo header
-                psh.source_address = udp_source.s_addr;
-                psh.dest_address = udp_target.s_addr;
-                psh.placeholder = 0;
-                psh.protocol = IPPROTO_UDP;
-                psh.udp_length = htons(sizeof(struct udphdr) + BLOCKSIZE );
-                memcpy(pseudogram , (char*) &psh , sizeof (struct pseudo_header));
-                memcpy(pseudogram + sizeof(struct pseudo_header) , udph , sizeof(struct udphdr) + BLOCKSIZE);
-                int psize = sizeof(struct pseudo_header) + sizeof(struct udphdr) + BLOCKSIZE;
-                udph->check = csum( (unsigned short*) pseudogram , psize);
-                //Send the packet
-                if (sendto (udp_socket, udp_buffer, iph->tot_len ,  0, (struct sockaddr *) &udp_server, sizeof (udp_server)) < 0)
-                {
-                    StreamTransmit = false;
-                    fprintf(stderr, "OpcUaServer : error sending UDP data stream\n");
-                    StreamError = closeStreamUDP();
-                };
-            };
+                StreamSourceStatus = STREAM_SOURCE_STALLED;
+                fprintf(stderr, "OpcUaServer : data stream stalled\n");
+            }
+            continue;
+        }
+        ssize_t bytes_read = read(fd, readbuffer + fill, buffersize - fill);
+        // no data despite poll() - should the driver not support it, avoid spinning
+        if ((bytes_read < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+        {
+            stream_sleep(STREAM_ERROR_MIN_MS);
+            continue;
+        }
+        // handle read errors and the end of the stream
+        if (bytes_read <= 0)
+        {
+            counter_add(&StreamReadErrors, 1);
+            if (backoff == 0)
+            {
+                if (bytes_read < 0)
+                    perror("OpcUaServer : read() from data stream");
+                else
+                    fprintf(stderr, "OpcUaServer : read() from data stream : end of file\n");
+                backoff = STREAM_ERROR_MIN_MS;
+            }
+            else if (backoff < STREAM_ERROR_MAX_MS)
+                backoff = (2*backoff < STREAM_ERROR_MAX_MS) ? 2*backoff : STREAM_ERROR_MAX_MS;
+            StreamSourceStatus = STREAM_SOURCE_ERROR;
+            stream_sleep(backoff);
+            continue;
+        };
+        backoff = 0;
+        counter_add(&SourceBytes, bytes_read);
+        if (bytes_read % BLOCKSIZE != 0)
+            counter_add(&SourcePartialReads, 1);
+        fill += bytes_read;
+        // handle all complete data blocks
+        size_t nrec = fill / BLOCKSIZE;
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        uint64_t received = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+        for (size_t i=0; i<nrec; i++)
+        {
+            struct single_pass_data *record = (struct single_pass_data *)(readbuffer + i*BLOCKSIZE);
+            sequence_check(&StreamSequence, record, received);
+            if (record->time != 0)
+                jitter_add(&ArrivalJitter, (int64_t)(received - record->time), received);
+            latency_add(&latency_hist[LATENCY_READ], record->time, received);
+            ring_write(&stream_ring, record);
         };
+        if (nrec > 0)
+        {
+            counter_add(&SourceRecords, nrec);
+            ring_notify(&stream_ring);
+            StreamLastRecord = stream_now_ms();
+            if (StreamSourceStatus != STREAM_SOURCE_GOOD)
+                printf("OpcUaServer : data stream resumed\n");
+            StreamSourceStatus = STREAM_SOURCE_GOOD;
+        }
+        // carry an incomplete record over to the next read
+        size_t rest = fill - nrec*BLOCKSIZE;
+        if ((rest > 0) && (nrec > 0))
+            memmove(readbuffer, readbuffer + nrec*BLOCKSIZE, rest);
+        fill = rest;
     };
-    printf("OpcUaServer : read thread exit\n");
+    free(readbuffer);
+    StreamSourceStatus = STREAM_SOURCE_CLOSED;
+    printf("OpcUaServer : read thread exit, %llu records, %llu read errors, %llu trigger gaps\n",
+        (unsigned long long)SourceRecords, (unsigned long long)StreamReadErrors, (unsigned long long)StreamSequence.gaps);
     pthread_exit(NULL);
 }
 
@@ -515,6 +1292,9 @@ int main(int argc, char *argv[])
 
     UA_ObjectAttributes object_attr;   // attributes for folders
     UA_VariableAttributes attr;        // attributes for variable nodes
+    UA_Int32 zeroInt32 = 0;            // initial values of the published variables
+    UA_Double zeroDouble = 0.0;
+    UA_DateTime zeroDateTime = 0;
 
     // initialize and test the MCI system
     if (mci_init() != 0)
@@ -526,7 +1306,20 @@ int main(int argc, char *argv[])
     int buflen;                        // number of valid characters in the buffer
     UA_String BufString;               // an UA_String representation of the buffer
     xmlDocPtr doc;                     // the resulting document tree
-    doc = xmlReadFile("/nvram/cfg/opcua.xml", NULL, 0);
+    // the configuration file may be given on the command line
+    const char *ConfigFile = (argc > 1) ? argv[1] : CONFIG_FILE;
+    // the snapshots of the settings are stored in the same directory
+    char ConfigDir[256] = ".";
+    const char *slash = strrchr(ConfigFile, '/');
+    if ((slash != NULL) && (slash - ConfigFile < (int)sizeof(ConfigDir)))
+    {
+        memcpy(ConfigDir, ConfigFile, slash - ConfigFile);
+        ConfigDir[slash - ConfigFile] = '\0';
+        if (slash == ConfigFile)
+            strcpy(ConfigDir, "/");
+    }
+    printf("OpcUaServer : ConfigFile=%s\n", ConfigFile);
+    doc = xmlReadFile(ConfigFile, NULL, 0);
     if (doc == NULL)
         Die("OpcUaServer : Failed to parse XML config file\n");
     // get the root element node
@@ -561,18 +1354,87 @@ int main(int argc, char *argv[])
     BufString = UA_STRING(buf);
     UA_String *DeviceName = UA_String_new();
     UA_String_copy(&BufString, DeviceName);
-    xmlNode *streamNode = NULL;
-    for (xmlNode *currNode = configurationNode->children; currNode; currNode = currNode->next)
-        if (currNode->type == XML_ELEMENT_NODE)
-            if (! strcmp(currNode->name, "stream"))
-                streamNode = currNode;
-    if (streamNode == NULL)
-        Die("OpcUaServer : Failed to find XML <stream> node\n");
-    xmlNode *streamsourceNode = NULL;
-    for (xmlNode *currNode = streamNode->children; currNode; currNode = currNode->next)
+    // the <opcua/publish> node is optional
+    xmlNode *publishNode = NULL;
+    for (xmlNode *currNode = opcuaNode->children; currNode; currNode = currNode->next)
         if (currNode->type == XML_ELEMENT_NODE)
-            if (! strcmp(currNode->name, "source"))
-                streamsourceNode = currNode;
+            if (! strcmp(currNode->name, "publish"))
+                publishNode = currNode;
+    if (publishNode != NULL)
+    {
+        xmlChar *rateProp = xmlGetProp(publishNode,"rate");
+        if (rateProp != NULL)
+        {
+            if (sscanf(rateProp, "%u", &PublishRate) != 1)
+                Die("OpcUaServer : Failed to read XML <opcua/publish> rate property\n");
+            if ((PublishRate < 1) || (PublishRate > PUBLISH_MAX_RATE))
+                Die("OpcUaServer : XML <opcua/publish> rate property out of range\n");
+            xmlFree(rateProp);
+        }
+    }
+    printf("OpcUaServer : PublishRate=%d Hz\n", PublishRate);
+    // the <opcua/history> node is optional
+    xmlNode *historyNode = NULL;
+    for (xmlNode *currNode = opcuaNode->children; currNode; currNode = currNode->next)
+        if (currNode->type == XML_ELEMENT_NODE)
+            if (! strcmp(currNode->name, "history"))
+                historyNode = currNode;
+    if (historyNode != NULL)
+    {
+        xmlChar *depthProp = xmlGetProp(historyNode,"depth");
+        if (depthProp != NULL)
+        {
+            if (sscanf(depthProp, "%u", &HistoryDepth) != 1)
+                Die("OpcUaServer : Failed to read XML <opcua/history> depth property\n");
+            if ((HistoryDepth < 1) || (HistoryDepth > HISTORY_MAX_DEPTH))
+                Die("OpcUaServer : XML <opcua/history> depth property out of range\n");
+            xmlFree(depthProp);
+        }
+    }
+    printf("OpcUaServer : HistoryDepth=%d\n", HistoryDepth);
+    // the <opcua/mirror> node is optional, it enables the mirror of the MCI tree
+    xmlNode *mirrorNode = NULL;
+    for (xmlNode *currNode = opcuaNode->children; currNode; currNode = currNode->next)
+        if (currNode->type == XML_ELEMENT_NODE)
+            if (! strcmp(currNode->name, "mirror"))
+                mirrorNode = currNode;
+    if (mirrorNode != NULL)
+    {
+        MirrorEnabled = true;
+        xmlChar *ttlProp = xmlGetProp(mirrorNode,"ttl");
+        if (ttlProp != NULL)
+        {
+            if (sscanf(ttlProp, "%u", &MirrorTTL) != 1)
+                Die("OpcUaServer : Failed to read XML <opcua/mirror> ttl property\n");
+            if ((MirrorTTL < 1) || (MirrorTTL > MIRROR_MAX_TTL))
+                Die("OpcUaServer : XML <opcua/mirror> ttl property out of range\n");
+            xmlFree(ttlProp);
+        }
+        xmlChar *writableProp = xmlGetProp(mirrorNode,"writable");
+        if (writableProp != NULL)
+        {
+            if (! strcmp(writableProp, "true"))
+                MirrorWritable = true;
+            else if (! strcmp(writableProp, "false"))
+                MirrorWritable = false;
+            else
+                Die("OpcUaServer : XML <opcua/mirror> writable property must be true or false\n");
+            xmlFree(writableProp);
+        }
+    }
+    printf("OpcUaServer : MirrorEnabled=%d MirrorTTL=%d ms MirrorWritable=%d\n", MirrorEnabled, MirrorTTL, MirrorWritable);
+    xmlNode *streamNode = NULL;
+    for (xmlNode *currNode = configurationNode->children; currNode; currNode = currNode->next)
+        if (currNode->type == XML_ELEMENT_NODE)
+            if (! strcmp(currNode->name, "stream"))
+                streamNode = currNode;
+    if (streamNode == NULL)
+        Die("OpcUaServer : Failed to find XML <stream> node\n");
+    xmlNode *streamsourceNode = NULL;
+    for (xmlNode *currNode = streamNode->children; currNode; currNode = currNode->next)
+        if (currNode->type == XML_ELEMENT_NODE)
+            if (! strcmp(currNode->name, "source"))
+                streamsourceNode = currNode;
     if (streamsourceNode == NULL)
         Die("OpcUaServer : Failed to find XML <stream/sorce> node\n");
     xmlChar *sourceipProp = xmlGetProp(streamsourceNode,"ip");
@@ -620,6 +1482,186 @@ int main(int argc, char *argv[])
     buf[buflen] = '\0';         // string termination
     if (sscanf(buf, "%d", &StreamTargetPort) != 1)
         Die("OpcUaServer : Failed to read XML <stream/target> port property\n");
+    // the <stream/input> node is optional
+    xmlNode *streaminputNode = NULL;
+    for (xmlNode *currNode = streamNode->children; currNode; currNode = currNode->next)
+        if (currNode->type == XML_ELEMENT_NODE)
+            if (! strcmp(currNode->name, "input"))
+                streaminputNode = currNode;
+    if (streaminputNode != NULL)
+    {
+        xmlChar *recordsProp = xmlGetProp(streaminputNode,"records");
+        if (recordsProp != NULL)
+        {
+            if (sscanf(recordsProp, "%u", &StreamReadRecords) != 1)
+                Die("OpcUaServer : Failed to read XML <stream/input> records property\n");
+            if ((StreamReadRecords < 1) || (StreamReadRecords > READBUFFER_MAX_RECORDS))
+                Die("OpcUaServer : XML <stream/input> records property out of range\n");
+            xmlFree(recordsProp);
+        }
+        xmlChar *ringProp = xmlGetProp(streaminputNode,"ring");
+        if (ringProp != NULL)
+        {
+            if (sscanf(ringProp, "%u", &StreamRingRecords) != 1)
+                Die("OpcUaServer : Failed to read XML <stream/input> ring property\n");
+            if ((StreamRingRecords < 2) || (StreamRingRecords > RING_MAX_RECORDS) ||
+                ((StreamRingRecords & (StreamRingRecords-1)) != 0))
+                Die("OpcUaServer : XML <stream/input> ring property must be a power of 2\n");
+            xmlFree(ringProp);
+        }
+        xmlChar *deviceProp = xmlGetProp(streaminputNode,"device");
+        if (deviceProp != NULL)
+        {
+            if ((xmlStrlen(deviceProp) == 0) || ((size_t)xmlStrlen(deviceProp) >= sizeof(StreamDevice)))
+                Die("OpcUaServer : XML <stream/input> device property has an invalid length\n");
+            strcpy(StreamDevice, deviceProp);
+            xmlFree(deviceProp);
+        }
+        xmlChar *stallProp = xmlGetProp(streaminputNode,"stall");
+        if (stallProp != NULL)
+        {
+            if (sscanf(stallProp, "%u", &StreamStallTime) != 1)
+                Die("OpcUaServer : Failed to read XML <stream/input> stall property\n");
+            if ((StreamStallTime < 1) || (StreamStallTime > STREAM_MAX_STALL_MS))
+                Die("OpcUaServer : XML <stream/input> stall property out of range\n");
+            xmlFree(stallProp);
+        }
+        xmlChar *lossProp = xmlGetProp(streaminputNode,"loss");
+        if (lossProp != NULL)
+        {
+            if (sscanf(lossProp, "%u", &StreamLossThreshold) != 1)
+                Die("OpcUaServer : Failed to read XML <stream/input> loss property\n");
+            if (StreamLossThreshold > STREAM_MAX_LOSS_THRESHOLD)
+                Die("OpcUaServer : XML <stream/input> loss property out of range\n");
+#ifndef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+            Die("OpcUaServer : XML <stream/input> loss property needs open62541 built with UA_ENABLE_SUBSCRIPTIONS_EVENTS\n");
+#endif
+            StreamLossCheck = true;
+            xmlFree(lossProp);
+        }
+    }
+    // the <stream/output> node is optional
+    xmlNode *streamoutputNode = NULL;
+    for (xmlNode *currNode = streamNode->children; currNode; currNode = currNode->next)
+        if (currNode->type == XML_ELEMENT_NODE)
+            if (! strcmp(currNode->name, "output"))
+                streamoutputNode = currNode;
+    if (streamoutputNode != NULL)
+    {
+        xmlChar *modeProp = xmlGetProp(streamoutputNode,"mode");
+        if (modeProp != NULL)
+        {
+            if (! strcmp(modeProp, "raw"))
+                StreamMode = UDP_MODE_RAW;
+            else if (! strcmp(modeProp, "datagram"))
+                StreamMode = UDP_MODE_DATAGRAM;
+            else
+                Die("OpcUaServer : XML <stream/output> mode property must be raw or datagram\n");
+            xmlFree(modeProp);
+        }
+        xmlChar *batchProp = xmlGetProp(streamoutputNode,"batch");
+        if (batchProp != NULL)
+        {
+            if (sscanf(batchProp, "%u", &StreamBatch) != 1)
+                Die("OpcUaServer : Failed to read XML <stream/output> batch property\n");
+            if ((StreamBatch < 1) || (StreamBatch > UDP_MAX_BATCH))
+                Die("OpcUaServer : XML <stream/output> batch property out of range\n");
+            xmlFree(batchProp);
+        }
+        xmlChar *precordsProp = xmlGetProp(streamoutputNode,"records");
+        if (precordsProp != NULL)
+        {
+            if (sscanf(precordsProp, "%u", &StreamPacketRecords) != 1)
+                Die("OpcUaServer : Failed to read XML <stream/output> records property\n");
+            if ((StreamPacketRecords < 1) || (StreamPacketRecords > UDP_MAX_RECORDS))
+                Die("OpcUaServer : XML <stream/output> records property out of range\n");
+            xmlFree(precordsProp);
+        }
+        xmlChar *latencyProp = xmlGetProp(streamoutputNode,"latency");
+        if (latencyProp != NULL)
+        {
+            if (sscanf(latencyProp, "%u", &StreamLatency) != 1)
+                Die("OpcUaServer : Failed to read XML <stream/output> latency property\n");
+            if (StreamLatency > UDP_MAX_LATENCY)
+                Die("OpcUaServer : XML <stream/output> latency property out of range\n");
+            xmlFree(latencyProp);
+        }
+    }
+    printf("OpcUaServer : StreamMode=%d StreamBatch=%d\n", StreamMode, StreamBatch);
+    printf("OpcUaServer : StreamPacketRecords=%d StreamLatency=%d ms\n", StreamPacketRecords, StreamLatency);
+    printf("OpcUaServer : StreamReadRecords=%d\n", StreamReadRecords);
+    printf("OpcUaServer : StreamRingRecords=%d\n", StreamRingRecords);
+    printf("OpcUaServer : StreamDevice=%s\n", StreamDevice);
+    printf("OpcUaServer : StreamStallTime=%d ms\n", StreamStallTime);
+    // the <stream/realtime> node is optional
+    xmlNode *realtimeNode = NULL;
+    for (xmlNode *currNode = streamNode->children; currNode; currNode = currNode->next)
+        if (currNode->type == XML_ELEMENT_NODE)
+            if (! strcmp(currNode->name, "realtime"))
+                realtimeNode = currNode;
+    if (realtimeNode != NULL)
+    {
+        xmlChar *lockProp = xmlGetProp(realtimeNode,"lock");
+        if (lockProp != NULL)
+        {
+            if (! strcmp(lockProp, "true"))
+                LockMemory = true;
+            else if (! strcmp(lockProp, "false"))
+                LockMemory = false;
+            else
+                Die("OpcUaServer : XML <stream/realtime> lock property must be true or false\n");
+            xmlFree(lockProp);
+        }
+        // <thread name="reader" priority="80" cpu="1" stack="131072"/>
+        // the name is "reader" or the name of a consumer stage
+        for (xmlNode *threadNode = realtimeNode->children; threadNode; threadNode = threadNode->next)
+        {
+            if ((threadNode->type != XML_ELEMENT_NODE) || strcmp(threadNode->name, "thread"))
+                continue;
+            RtThreadConfig *rt = NULL;
+            xmlChar *nameProp = xmlGetProp(threadNode,"name");
+            if (nameProp == NULL)
+                Die("OpcUaServer : XML <stream/realtime/thread> has no name property\n");
+            if (! strcmp(nameProp, "reader"))
+                rt = &ReaderThread;
+            for (size_t i=0; i<NUM_STREAM_STAGES; i++)
+                if (! strcmp(nameProp, stream_stages[i].name))
+                    rt = &stream_stages[i].rt;
+            if (rt == NULL)
+                Die("OpcUaServer : XML <stream/realtime/thread> has an unknown name\n");
+            xmlFree(nameProp);
+            xmlChar *priorityProp = xmlGetProp(threadNode,"priority");
+            if (priorityProp != NULL)
+            {
+                if (sscanf(priorityProp, "%d", &rt->priority) != 1)
+                    Die("OpcUaServer : Failed to read XML <stream/realtime/thread> priority property\n");
+                if ((rt->priority < RT_MIN_PRIORITY) || (rt->priority > RT_MAX_PRIORITY))
+                    Die("OpcUaServer : XML <stream/realtime/thread> priority property out of range\n");
+                xmlFree(priorityProp);
+            }
+            xmlChar *cpuProp = xmlGetProp(threadNode,"cpu");
+            if (cpuProp != NULL)
+            {
+                if (sscanf(cpuProp, "%d", &rt->cpu) != 1)
+                    Die("OpcUaServer : Failed to read XML <stream/realtime/thread> cpu property\n");
+                if ((rt->cpu < 0) || (rt->cpu >= CPU_SETSIZE))
+                    Die("OpcUaServer : XML <stream/realtime/thread> cpu property out of range\n");
+                xmlFree(cpuProp);
+            }
+            xmlChar *stackProp = xmlGetProp(threadNode,"stack");
+            if (stackProp != NULL)
+            {
+                unsigned int stack;
+                if (sscanf(stackProp, "%u", &stack) != 1)
+                    Die("OpcUaServer : Failed to read XML <stream/realtime/thread> stack property\n");
+                if ((stack < PTHREAD_STACK_MIN) || (stack > RT_MAX_STACK))
+                    Die("OpcUaServer : XML <stream/realtime/thread> stack property out of range\n");
+                rt->stack = stack;
+                xmlFree(stackProp);
+            }
+        }
+    }
+    printf("OpcUaServer : LockMemory=%d\n", LockMemory);
     // done with the XML document
     xmlFreeDoc(doc);
     xmlCleanupParser();
@@ -627,6 +1669,8 @@ int main(int argc, char *argv[])
     // server will be running until we receive a SIGINT or SIGTERM
     signal(SIGINT,  stopHandler);
     signal(SIGTERM, stopHandler);
+    // SIGUSR1 prints the latency histograms
+    signal(SIGUSR1, dumpHandler);
 
     // configure the UA server
     UA_ServerConfig config;
@@ -637,6 +1681,9 @@ int main(int argc, char *argv[])
         printf("UA_ServerConfig_setMinimal() error %8x\n", res);
         exit(-1);
     }
+    // the mirror creates the nodes of MCI folders when the server accesses them
+    if (MirrorEnabled)
+        mirror_hook(&config);
     UA_Server *server = UA_Server_newWithConfig(&config);
     if(!server)
     {
@@ -648,6 +1695,13 @@ int main(int argc, char *argv[])
     Device
     |   Name
     |   SampleFreq
+    |   MciCacheHits
+    |   MciCacheMisses
+    |   MciConnected
+    |   MciReconnects
+    |   SaveSnapshot()
+    |   RestoreSnapshot()
+    |   ListSnapshots()
     **************************/
 
     object_attr = UA_ObjectAttributes_default;
@@ -682,24 +1736,87 @@ int main(int argc, char *argv[])
                               NULL);                                        // UA_NodeId *outNewNodeId
 
     attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","ADC sample frequency");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","SampleFreq");
+    attr.description = UA_LOCALIZEDTEXT("en_US","MCI reads answered from the cache");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","MciCacheHits");
+    attr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_DataSource mciHitsDataSource = (UA_DataSource)
+        {
+            .read = mci_get_cache_hits,
+            .write = NULL
+        };
+    UA_Server_addDataSourceVariableNode(
+            server,
+            UA_NODEID_NUMERIC(1, LIBERA_MCIHITS_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_DEVICE_ID),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+            UA_QUALIFIEDNAME(1, "MciCacheHits"),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            attr,
+            mciHitsDataSource,
+            NULL, NULL);
+
+    attr = UA_VariableAttributes_default;
+    attr.description = UA_LOCALIZEDTEXT("en_US","MCI reads of expired cache values");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","MciCacheMisses");
+    attr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_DataSource mciMissesDataSource = (UA_DataSource)
+        {
+            .read = mci_get_cache_misses,
+            .write = NULL
+        };
+    UA_Server_addDataSourceVariableNode(
+            server,
+            UA_NODEID_NUMERIC(1, LIBERA_MCIMISSES_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_DEVICE_ID),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+            UA_QUALIFIEDNAME(1, "MciCacheMisses"),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            attr,
+            mciMissesDataSource,
+            NULL, NULL);
+
+    attr = UA_VariableAttributes_default;
+    attr.description = UA_LOCALIZEDTEXT("en_US","connection to the LiberaBase application");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","MciConnected");
+    attr.dataType = UA_TYPES[UA_TYPES_BOOLEAN].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_DataSource mciConnectedDataSource = (UA_DataSource)
+        {
+            .read = mci_get_connected,
+            .write = NULL
+        };
+    UA_Server_addDataSourceVariableNode(
+            server,
+            UA_NODEID_NUMERIC(1, LIBERA_MCICONNECTED_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_DEVICE_ID),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+            UA_QUALIFIEDNAME(1, "MciConnected"),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            attr,
+            mciConnectedDataSource,
+            NULL, NULL);
+
+    attr = UA_VariableAttributes_default;
+    attr.description = UA_LOCALIZEDTEXT("en_US","number of reconnects to the LiberaBase application");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","MciReconnects");
     attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource devFreqDataSource = (UA_DataSource)
+    UA_DataSource mciReconnectsDataSource = (UA_DataSource)
         {
-            .read = mci_get_dev_freq,
+            .read = mci_get_reconnects,
             .write = NULL
         };
     UA_Server_addDataSourceVariableNode(
             server,
-            UA_NODEID_NUMERIC(1, LIBERA_DEVFREQ_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_MCIRECONNECTS_ID),
             UA_NODEID_NUMERIC(1, LIBERA_DEVICE_ID),
             UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "SampleFreq"),
+            UA_QUALIFIEDNAME(1, "MciReconnects"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            devFreqDataSource,
+            mciReconnectsDataSource,
             NULL, NULL);
     
     /**************************
@@ -713,7 +1830,19 @@ int main(int argc, char *argv[])
     |   |   PosX
     |   |   PosY
     |   |   ShapeQ
+    |   |   ReceiveTime
     |   MaxADC
+    |   History
+    |   |   VA
+    |   |   VB
+    |   |   VC
+    |   |   VD
+    |   |   Charge
+    |   |   PosX
+    |   |   PosY
+    |   |   ShapeQ
+    |   |   TriggerCnt
+    |   |   Time
     **************************/
 
     object_attr = UA_ObjectAttributes_default;
@@ -747,12 +1876,9 @@ int main(int argc, char *argv[])
     attr.displayName = UA_LOCALIZEDTEXT("en_US","VA");
     attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource vaDataSource = (UA_DataSource)
-        {
-            .read = readInt32,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroInt32, &UA_TYPES[UA_TYPES_INT32]);
+    UA_Server_addVariableNode(
             server,
             UA_NODEID_NUMERIC(1, LIBERA_VA_ID),
             UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
@@ -760,20 +1886,16 @@ int main(int argc, char *argv[])
             UA_QUALIFIEDNAME(1, "VA"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            vaDataSource,
-            &SP_va, NULL);
+            NULL, NULL);
 
     attr = UA_VariableAttributes_default;
     attr.description = UA_LOCALIZEDTEXT("en_US","channel B raw signal");
     attr.displayName = UA_LOCALIZEDTEXT("en_US","VB");
     attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource vbDataSource = (UA_DataSource)
-        {
-            .read = readInt32,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroInt32, &UA_TYPES[UA_TYPES_INT32]);
+    UA_Server_addVariableNode(
             server,
             UA_NODEID_NUMERIC(1, LIBERA_VB_ID),
             UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
@@ -781,20 +1903,16 @@ int main(int argc, char *argv[])
             UA_QUALIFIEDNAME(1, "VB"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            vbDataSource,
-            &SP_vb, NULL);
+            NULL, NULL);
 
     attr = UA_VariableAttributes_default;
     attr.description = UA_LOCALIZEDTEXT("en_US","channel C raw signal");
     attr.displayName = UA_LOCALIZEDTEXT("en_US","VC");
     attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource vcDataSource = (UA_DataSource)
-        {
-            .read = readInt32,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroInt32, &UA_TYPES[UA_TYPES_INT32]);
+    UA_Server_addVariableNode(
             server,
             UA_NODEID_NUMERIC(1, LIBERA_VC_ID),
             UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
@@ -802,20 +1920,16 @@ int main(int argc, char *argv[])
             UA_QUALIFIEDNAME(1, "VC"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            vcDataSource,
-            &SP_vc, NULL);
+            NULL, NULL);
 
     attr = UA_VariableAttributes_default;
     attr.description = UA_LOCALIZEDTEXT("en_US","channel D raw signal");
     attr.displayName = UA_LOCALIZEDTEXT("en_US","VD");
     attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource vdDataSource = (UA_DataSource)
-        {
-            .read = readInt32,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroInt32, &UA_TYPES[UA_TYPES_INT32]);
+    UA_Server_addVariableNode(
             server,
             UA_NODEID_NUMERIC(1, LIBERA_VD_ID),
             UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
@@ -823,20 +1937,16 @@ int main(int argc, char *argv[])
             UA_QUALIFIEDNAME(1, "VD"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            vdDataSource,
-            &SP_vd, NULL);
+            NULL, NULL);
 
     attr = UA_VariableAttributes_default;
     attr.description = UA_LOCALIZEDTEXT("en_US","Bunch charge in pC");
     attr.displayName = UA_LOCALIZEDTEXT("en_US","Charge");
     attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource chargeDataSource = (UA_DataSource)
-        {
-            .read = readDouble,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroDouble, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_addVariableNode(
             server,
             UA_NODEID_NUMERIC(1, LIBERA_CHARGE_ID),
             UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
@@ -844,20 +1954,16 @@ int main(int argc, char *argv[])
             UA_QUALIFIEDNAME(1, "Charge"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            chargeDataSource,
-            &SP_charge, NULL);
+            NULL, NULL);
 
     attr = UA_VariableAttributes_default;
     attr.description = UA_LOCALIZEDTEXT("en_US","Position X in mm");
     attr.displayName = UA_LOCALIZEDTEXT("en_US","PosX");
     attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource posxDataSource = (UA_DataSource)
-        {
-            .read = readDouble,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroDouble, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_addVariableNode(
             server,
             UA_NODEID_NUMERIC(1, LIBERA_POSX_ID),
             UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
@@ -865,20 +1971,16 @@ int main(int argc, char *argv[])
             UA_QUALIFIEDNAME(1, "PosX"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            posxDataSource,
-            &SP_pos_x, NULL);
+            NULL, NULL);
 
     attr = UA_VariableAttributes_default;
     attr.description = UA_LOCALIZEDTEXT("en_US","Position Y in mm");
     attr.displayName = UA_LOCALIZEDTEXT("en_US","PosY");
     attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource posyDataSource = (UA_DataSource)
-        {
-            .read = readDouble,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroDouble, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_addVariableNode(
             server,
             UA_NODEID_NUMERIC(1, LIBERA_POSY_ID),
             UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
@@ -886,20 +1988,16 @@ int main(int argc, char *argv[])
             UA_QUALIFIEDNAME(1, "PosY"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            posyDataSource,
-            &SP_pos_y, NULL);
+            NULL, NULL);
 
     attr = UA_VariableAttributes_default;
     attr.description = UA_LOCALIZEDTEXT("en_US","shape parameter q");
     attr.displayName = UA_LOCALIZEDTEXT("en_US","ShapeQ");
     attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource shapeqDataSource = (UA_DataSource)
-        {
-            .read = readDouble,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroDouble, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_addVariableNode(
             server,
             UA_NODEID_NUMERIC(1, LIBERA_SHAPEQ_ID),
             UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
@@ -907,39 +2005,84 @@ int main(int argc, char *argv[])
             UA_QUALIFIEDNAME(1, "ShapeQ"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            shapeqDataSource,
-            &SP_shape_q, NULL);
+            NULL, NULL);
 
     attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","maximum ADC value");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","MaxADC");
-    attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
+    attr.description = UA_LOCALIZEDTEXT("en_US","time of reception of the shot");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","ReceiveTime");
+    attr.dataType = UA_TYPES[UA_TYPES_DATETIME].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ;
-    UA_DataSource maxADCDataSource = (UA_DataSource)
-        {
-            .read = mci_get_maxadc,
-            .write = NULL
-        };
-    UA_Server_addDataSourceVariableNode(
+    attr.minimumSamplingInterval = 1000.0 / PublishRate;
+    UA_Variant_setScalar(&attr.value, &zeroDateTime, &UA_TYPES[UA_TYPES_DATETIME]);
+    UA_Server_addVariableNode(
             server,
-            UA_NODEID_NUMERIC(1, LIBERA_MAXADC_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_SIGNALS_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_RECEIVETIME_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_SP_ID),
             UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "MaxADC"),
+            UA_QUALIFIEDNAME(1, "ReceiveTime"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            maxADCDataSource,
             NULL, NULL);
 
+    object_attr = UA_ObjectAttributes_default;
+    object_attr.description = UA_LOCALIZEDTEXT("en_US","History");
+    object_attr.displayName = UA_LOCALIZEDTEXT("en_US","History");
+    UA_Server_addObjectNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_HISTORY_ID),
+                            UA_NODEID_NUMERIC(1, LIBERA_SIGNALS_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                            UA_QUALIFIEDNAME(1, "History"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            object_attr,
+                            NULL,
+                            NULL);
+
+    // the history arrays all have the same structure
+    for (size_t i=0; i<NUM_HISTORY_VARIABLES; i++)
+    {
+        attr = UA_VariableAttributes_default;
+        attr.description = UA_LOCALIZEDTEXT("en_US", history_variables[i].description);
+        attr.displayName = UA_LOCALIZEDTEXT("en_US", history_variables[i].name);
+        attr.dataType = UA_TYPES[history_variables[i].type].typeId;
+        attr.valueRank = UA_VALUERANK_ONE_DIMENSION;
+        attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        UA_DataSource historyDataSource = (UA_DataSource)
+            {
+                .read = readHistory,
+                .write = NULL
+            };
+        UA_Server_addDataSourceVariableNode(
+                server,
+                UA_NODEID_NUMERIC(1, history_variables[i].id),
+                UA_NODEID_NUMERIC(1, LIBERA_HISTORY_ID),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                UA_QUALIFIEDNAME(1, history_variables[i].name),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                attr,
+                historyDataSource,
+                (void *)&history_variables[i], NULL);
+    }
+
     /**************************
     Stream
     |   StreamStatus
     |   TransmissionStatus
+    |   SourceIdle
+    |   ArrivalJitter
+    |   ArrivalJitterPeak
     |   SourceIP
     |   SourcePort
     |   TargetIP
     |   TargetPort
     |   Transmit
+    |   Mode
+    |   Batch
+    |   PacketRecords
+    |   Latency
+    |   Statistics
+    |   |   RecordsRead
+    |   |   RecordRate
+    |   |   ...
     **************************/
 
     object_attr = UA_ObjectAttributes_default;
@@ -956,14 +2099,14 @@ int main(int argc, char *argv[])
                             NULL);
 
     attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","Status of the /dev/libera.strm0 source stream");
+    attr.description = UA_LOCALIZEDTEXT("en_US","Status of the source stream (-1 closed, 0 good, 1 stalled, 2 error)");
     attr.displayName = UA_LOCALIZEDTEXT("en_US","StreamStatus");
     attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
     UA_DataSource streamstatusDataSource = (UA_DataSource)
         {
             .read = readInt32,
-            .write = writeInt32
+            .write = NULL
         };
     UA_Server_addDataSourceVariableNode(
             server,
@@ -974,7 +2117,7 @@ int main(int argc, char *argv[])
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
             streamstatusDataSource,
-            &StreamSourceStatus, NULL);
+            (void *)&StreamSourceStatus, NULL);
 
 
     attr = UA_VariableAttributes_default;
@@ -998,6 +2141,64 @@ int main(int argc, char *argv[])
             streamerrorDataSource,
             &StreamError, NULL);
 
+    attr = UA_VariableAttributes_default;
+    attr.description = UA_LOCALIZEDTEXT("en_US","RMS variation of the record arrival latency during the last second [us]");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","ArrivalJitter");
+    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_DataSource jitterDataSource = (UA_DataSource)
+        {
+            .read = readJitter,
+            .write = NULL
+        };
+    UA_Server_addDataSourceVariableNode(
+            server,
+            UA_NODEID_NUMERIC(1, LIBERA_ARRIVALJITTER_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAM_ID),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+            UA_QUALIFIEDNAME(1, "ArrivalJitter"),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            attr,
+            jitterDataSource,
+            NULL, NULL);
+
+    attr = UA_VariableAttributes_default;
+    attr.description = UA_LOCALIZEDTEXT("en_US","peak-to-peak variation of the record arrival latency during the last second [us]");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","ArrivalJitterPeak");
+    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_Server_addDataSourceVariableNode(
+            server,
+            UA_NODEID_NUMERIC(1, LIBERA_ARRIVALJITTERPEAK_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAM_ID),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+            UA_QUALIFIEDNAME(1, "ArrivalJitterPeak"),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            attr,
+            jitterDataSource,
+            (void *)1, NULL);
+
+    attr = UA_VariableAttributes_default;
+    attr.description = UA_LOCALIZEDTEXT("en_US","time since the last record was received from the source stream [ms]");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","SourceIdle");
+    attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_DataSource sourceidleDataSource = (UA_DataSource)
+        {
+            .read = readSourceIdle,
+            .write = NULL
+        };
+    UA_Server_addDataSourceVariableNode(
+            server,
+            UA_NODEID_NUMERIC(1, LIBERA_SOURCEIDLE_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAM_ID),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+            UA_QUALIFIEDNAME(1, "SourceIdle"),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            attr,
+            sourceidleDataSource,
+            NULL, NULL);
+
     // create the StreamSourceIP variable
     // read-only value defined in the configuration file
     attr = UA_VariableAttributes_default;
@@ -1100,154 +2301,209 @@ int main(int argc, char *argv[])
             transmitDataSource,
             &StreamTransmit, NULL);
 
-    /**************************
-    DSP
-    |   Enable
-    |   BunchThr1
-    |   PreTrig
-    |   PostTrig1
-    |   ScanTimeout
-    |   Averaging
-    **************************/
-
-    object_attr = UA_ObjectAttributes_default;
-    object_attr.description = UA_LOCALIZEDTEXT("en_US","DSP");
-    object_attr.displayName = UA_LOCALIZEDTEXT("en_US","DSP");
-    UA_Server_addObjectNode(server,
-                            UA_NODEID_NUMERIC(1, LIBERA_DSP_ID),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-                            UA_QUALIFIEDNAME(1, "DSP"),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
-                            object_attr,
-                            NULL,
-                            NULL);
-
     attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","DSP enable");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","DspEnable");
-    attr.dataType = UA_TYPES[UA_TYPES_BOOLEAN].typeId;
+    attr.description = UA_LOCALIZEDTEXT("en_US","UDP transport mode (0=raw, 1=datagram), used when the stream is opened");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","Mode");
+    attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource dspEnableDataSource = (UA_DataSource)
+    UA_DataSource streammodeDataSource = (UA_DataSource)
         {
-            .read = mci_get_dsp_enable,
-            .write = mci_set_dsp_enable
+            .read = readInt32,
+            .write = writeMode
         };
     UA_Server_addDataSourceVariableNode(
             server,
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_ENABLE_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAMMODE_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAM_ID),
             UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "DspEnable"),
+            UA_QUALIFIEDNAME(1, "Mode"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            dspEnableDataSource,
-            NULL, NULL);
+            streammodeDataSource,
+            &StreamMode, NULL);
 
     attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","DSP bunch threshold 1");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","DspThr1");
+    attr.description = UA_LOCALIZEDTEXT("en_US","maximum number of packets sent with one system call in datagram mode");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","Batch");
     attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource dspThr1DataSource = (UA_DataSource)
+    UA_DataSource streambatchDataSource = (UA_DataSource)
         {
-            .read = mci_get_dsp_thr1,
-            .write = mci_set_dsp_thr1
+            .read = readUInt32,
+            .write = writeBatch
         };
     UA_Server_addDataSourceVariableNode(
             server,
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_THR1_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAMBATCH_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAM_ID),
             UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "DspThr1"),
+            UA_QUALIFIEDNAME(1, "Batch"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            dspThr1DataSource,
-            NULL, NULL);
+            streambatchDataSource,
+            &StreamBatch, NULL);
 
     attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","DSP number of pre-trigger samples");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","DspPre");
+    attr.description = UA_LOCALIZEDTEXT("en_US","number of records packed into one UDP packet");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","PacketRecords");
     attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource dspPreDataSource = (UA_DataSource)
+    UA_DataSource packetrecordsDataSource = (UA_DataSource)
         {
-            .read = mci_get_dsp_pre,
-            .write = mci_set_dsp_pre
+            .read = readUInt32,
+            .write = writePacketRecords
         };
     UA_Server_addDataSourceVariableNode(
             server,
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_PRE_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_PACKETRECORDS_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAM_ID),
             UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "DspPre"),
+            UA_QUALIFIEDNAME(1, "PacketRecords"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            dspPreDataSource,
-            NULL, NULL);
+            packetrecordsDataSource,
+            &StreamPacketRecords, NULL);
 
     attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","DSP number of samples for first frame");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","DspPost1");
+    attr.description = UA_LOCALIZEDTEXT("en_US","maximum delay [ms] of a partially filled UDP packet (0...1000), applied when the stream is opened");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","Latency");
     attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
     attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource dspPost1DataSource = (UA_DataSource)
+    UA_DataSource latencyDataSource = (UA_DataSource)
         {
-            .read = mci_get_dsp_post1,
-            .write = mci_set_dsp_post1
+            .read = readUInt32,
+            .write = writeLatency
         };
     UA_Server_addDataSourceVariableNode(
             server,
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_POST1_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_LATENCY_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STREAM_ID),
             UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "DspPost1"),
+            UA_QUALIFIEDNAME(1, "Latency"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            dspPost1DataSource,
-            NULL, NULL);
+            latencyDataSource,
+            &StreamLatency, NULL);
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","DSP scan timeout");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","DspTimeout");
-    attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource dspTimeoutDataSource = (UA_DataSource)
+    object_attr = UA_ObjectAttributes_default;
+    object_attr.description = UA_LOCALIZEDTEXT("en_US","counters and rates of the source and UDP streams");
+    object_attr.displayName = UA_LOCALIZEDTEXT("en_US","Statistics");
+    UA_Server_addObjectNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_STATISTICS_ID),
+                            UA_NODEID_NUMERIC(1, LIBERA_STREAM_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                            UA_QUALIFIEDNAME(1, "Statistics"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            object_attr,
+                            NULL,
+                            NULL);
+    UA_DataSource statisticsDataSource = (UA_DataSource)
         {
-            .read = mci_get_dsp_timeout,
-            .write = mci_set_dsp_timeout
+            .read = readStatistics,
+            .write = NULL
         };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_TIMEOUT_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "DspTimeout"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            dspTimeoutDataSource,
-            NULL, NULL);
-
+    // every counter followed by its rate
+    for (size_t i=0; i<NUM_STREAM_STATISTICS; i++)
+    {
+        const StatisticsVariable *var = &statistics_variables[i];
+        attr = UA_VariableAttributes_default;
+        attr.description = UA_LOCALIZEDTEXT("en_US", (char *)var->description);
+        attr.displayName = UA_LOCALIZEDTEXT("en_US", (char *)var->name);
+        attr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+        attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        UA_Server_addDataSourceVariableNode(
+                server,
+                UA_NODEID_NUMERIC(1, LIBERA_STATISTICS_ID + LIBERA_STAT_STEP * (i+1)),
+                UA_NODEID_NUMERIC(1, LIBERA_STATISTICS_ID),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                UA_QUALIFIEDNAME(1, (char *)var->name),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                attr,
+                statisticsDataSource,
+                (void *)(uintptr_t)i, NULL);
+        if (var->rate_name == NULL)
+            continue;
+        attr = UA_VariableAttributes_default;
+        attr.description = UA_LOCALIZEDTEXT("en_US", (char *)var->rate_description);
+        attr.displayName = UA_LOCALIZEDTEXT("en_US", (char *)var->rate_name);
+        attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
+        attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        UA_Server_addDataSourceVariableNode(
+                server,
+                UA_NODEID_NUMERIC(1, LIBERA_STAT_RATE_ID + LIBERA_STAT_STEP * (i+1)),
+                UA_NODEID_NUMERIC(1, LIBERA_STATISTICS_ID),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                UA_QUALIFIEDNAME(1, (char *)var->rate_name),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                attr,
+                statisticsDataSource,
+                (void *)(uintptr_t)(NUM_STREAM_STATISTICS + i), NULL);
+    }
     attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","DSP averaging");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","DspAveraging");
-    attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource dspAveragingDataSource = (UA_DataSource)
+    attr.description = UA_LOCALIZEDTEXT("en_US","recent gaps, reorderings, duplicates and resets of the trigger counter, the newest first");
+    attr.displayName = UA_LOCALIZEDTEXT("en_US","SequenceEvents");
+    attr.dataType = UA_TYPES[UA_TYPES_STRING].typeId;
+    attr.valueRank = UA_VALUERANK_ONE_DIMENSION;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    UA_DataSource sequenceDataSource = (UA_DataSource)
         {
-            .read = mci_get_dsp_averaging,
-            .write = mci_set_dsp_averaging
+            .read = readSequenceEvents,
+            .write = NULL
         };
     UA_Server_addDataSourceVariableNode(
             server,
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_AVERAGING_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_DSP_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_SEQUENCEEVENTS_ID),
+            UA_NODEID_NUMERIC(1, LIBERA_STATISTICS_ID),
             UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "DspAveraging"),
+            UA_QUALIFIEDNAME(1, "SequenceEvents"),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
             attr,
-            dspAveragingDataSource,
+            sequenceDataSource,
             NULL, NULL);
+#ifdef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+    // the event raised on the Server object when too many triggers have been missed
+    UA_ObjectTypeAttributes eventtype_attr = UA_ObjectTypeAttributes_default;
+    eventtype_attr.description = UA_LOCALIZEDTEXT("en_US","more triggers missed in the data stream than tolerated");
+    eventtype_attr.displayName = UA_LOCALIZEDTEXT("en_US","StreamLossEventType");
+    if (UA_Server_addObjectTypeNode(server,
+                                    UA_NODEID_NUMERIC(1, LIBERA_LOSSEVENTTYPE_ID),
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_BASEEVENTTYPE),
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE),
+                                    UA_QUALIFIEDNAME(1, "StreamLossEventType"),
+                                    eventtype_attr,
+                                    NULL,
+                                    &StreamLossEventType) != UA_STATUSCODE_GOOD)
+        Die("OpcUaServer : failed to create the StreamLossEventType");
+#else
+    printf("OpcUaServer : warning - open62541 built without UA_ENABLE_SUBSCRIPTIONS_EVENTS, no StreamLossEvents\n");
+#endif
+    sequence_init(&StreamSequence);
+    statistics_time = stream_now_ms();
+    if (UA_Server_addRepeatedCallback(server, updateStatistics, NULL, 1000.0, NULL) != UA_STATUSCODE_GOOD)
+        Die("OpcUaServer : failed to install the statistics callback");
+
+    /**************************
+    DSP
+    |   Enable
+    |   BunchThr1
+    |   PreTrig
+    |   PostTrig1
+    |   ScanTimeout
+    |   Averaging
+    **************************/
+
+    object_attr = UA_ObjectAttributes_default;
+    object_attr.description = UA_LOCALIZEDTEXT("en_US","DSP");
+    object_attr.displayName = UA_LOCALIZEDTEXT("en_US","DSP");
+    UA_Server_addObjectNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_DSP_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                            UA_QUALIFIEDNAME(1, "DSP"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            object_attr,
+                            NULL,
+                            NULL);
 
     /**************************
     Calibration
@@ -1264,6 +2520,7 @@ int main(int argc, char *argv[])
     |   OffsetY
     |   OffsetQ
     |   OffsetSum
+    |   ApplyCalibration()
     **************************/
 
     object_attr = UA_ObjectAttributes_default;
@@ -1278,300 +2535,317 @@ int main(int argc, char *argv[])
                             object_attr,
                             NULL,
                             NULL);
-    
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","attenuator setting");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","Attenuation");
-    attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calAttDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_attenuation,
-            .write = mci_set_cal_attenuation
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ATT_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "Attenuation"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calAttDataSource,
-            NULL, NULL);
-
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","channel A calibration factor");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","KA");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calKADataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_ka,
-            .write = mci_set_cal_ka
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_KA_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "KA"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calKADataSource,
-            NULL, NULL);
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","channel B calibration factor");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","KB");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calKBDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_kb,
-            .write = mci_set_cal_kb
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_KB_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "KB"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calKBDataSource,
-            NULL, NULL);
+    /**************************
+    MCI parameters
+    Device/SampleFreq, Signals/MaxADC
+    and the contents of DSP and Calibration
+    **************************/
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","channel C calibration factor");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","KC");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calKCDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_kc,
-            .write = mci_set_cal_kc
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_KC_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "KC"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calKCDataSource,
-            NULL, NULL);
+    // all variables mirroring MCI parameters are created from the registry
+    for (int i=0; i<mci_num_params(); i++)
+    {
+        const MciParamInfo *info = mci_param_info(i);
+        attr = UA_VariableAttributes_default;
+        attr.description = UA_LOCALIZEDTEXT("en_US", (char *)info->description);
+        attr.displayName = UA_LOCALIZEDTEXT("en_US", (char *)info->name);
+        attr.dataType = UA_TYPES[info->type].typeId;
+        attr.accessLevel = info->access;
+        UA_DataSource mciDataSource = (UA_DataSource)
+            {
+                .read = mci_read,
+                .write = (info->access & UA_ACCESSLEVELMASK_WRITE) ? mci_write : NULL
+            };
+        UA_Server_addDataSourceVariableNode(
+                server,
+                UA_NODEID_NUMERIC(1, info->id),
+                UA_NODEID_NUMERIC(1, info->parent),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                UA_QUALIFIEDNAME(1, (char *)info->name),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                attr,
+                mciDataSource,
+                (void *)info, NULL);
+    }
+    
+    // the method applying a complete calibration
+    // its arguments are named like the parameter variables
+    UA_Argument calibrationArgs[NUM_CALIBRATION_PARAMS];
+    for (size_t i=0; i<NUM_CALIBRATION_PARAMS; i++)
+    {
+        calibration_params[i] = NULL;
+        for (int k=0; k<mci_num_params(); k++)
+            if (mci_param_info(k)->id == calibration_ids[i])
+                calibration_params[i] = mci_param_info(k);
+        if (calibration_params[i] == NULL)
+            Die("OpcUaServer : calibration parameter missing in the MCI registry");
+        UA_Argument_init(&calibrationArgs[i]);
+        calibrationArgs[i].name = UA_STRING((char *)calibration_params[i]->name);
+        calibrationArgs[i].description = UA_LOCALIZEDTEXT("en_US", (char *)calibration_params[i]->description);
+        calibrationArgs[i].dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
+        calibrationArgs[i].valueRank = UA_VALUERANK_SCALAR;
+    }
+    UA_Argument calibrationStatus;
+    UA_Argument_init(&calibrationStatus);
+    calibrationStatus.name = UA_STRING("Status");
+    calibrationStatus.description = UA_LOCALIZEDTEXT("en_US", "status of every parameter in the order of the arguments");
+    calibrationStatus.dataType = UA_TYPES[UA_TYPES_STATUSCODE].typeId;
+    calibrationStatus.valueRank = UA_VALUERANK_ONE_DIMENSION;
+    UA_MethodAttributes method_attr = UA_MethodAttributes_default;
+    method_attr.description = UA_LOCALIZEDTEXT("en_US","validate, write and verify the complete calibration");
+    method_attr.displayName = UA_LOCALIZEDTEXT("en_US","ApplyCalibration");
+    method_attr.executable = true;
+    method_attr.userExecutable = true;
+    UA_Server_addMethodNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_CAL_APPLY_ID),
+                            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "ApplyCalibration"),
+                            method_attr,
+                            &applyCalibration,
+                            NUM_CALIBRATION_PARAMS, calibrationArgs,
+                            1, &calibrationStatus,
+                            NULL, NULL);
+
+    // the methods saving and restoring snapshots of the DSP and Calibration settings
+    if (settings_init(DeviceName, ConfigDir) == 0)
+        Die("OpcUaServer : no settings found in the MCI registry");
+    UA_Argument snapshotName;
+    UA_Argument_init(&snapshotName);
+    snapshotName.name = UA_STRING("Name");
+    snapshotName.description = UA_LOCALIZEDTEXT("en_US", "name of the snapshot [A-Za-z0-9_-]");
+    snapshotName.dataType = UA_TYPES[UA_TYPES_STRING].typeId;
+    snapshotName.valueRank = UA_VALUERANK_SCALAR;
+    UA_Argument snapshotCount;
+    UA_Argument_init(&snapshotCount);
+    snapshotCount.name = UA_STRING("Parameters");
+    snapshotCount.description = UA_LOCALIZEDTEXT("en_US", "number of parameters saved");
+    snapshotCount.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
+    snapshotCount.valueRank = UA_VALUERANK_SCALAR;
+    method_attr = UA_MethodAttributes_default;
+    method_attr.description = UA_LOCALIZEDTEXT("en_US","save the DSP and Calibration settings to nvram");
+    method_attr.displayName = UA_LOCALIZEDTEXT("en_US","SaveSnapshot");
+    method_attr.executable = true;
+    method_attr.userExecutable = true;
+    UA_Server_addMethodNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_SAVESNAPSHOT_ID),
+                            UA_NODEID_NUMERIC(1, LIBERA_DEVICE_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "SaveSnapshot"),
+                            method_attr,
+                            &saveSnapshot,
+                            1, &snapshotName,
+                            1, &snapshotCount,
+                            NULL, NULL);
+    UA_Argument restoreOutput[2];
+    UA_Argument_init(&restoreOutput[0]);
+    restoreOutput[0].name = UA_STRING("Parameters");
+    restoreOutput[0].description = UA_LOCALIZEDTEXT("en_US", "MCI paths of the parameters");
+    restoreOutput[0].dataType = UA_TYPES[UA_TYPES_STRING].typeId;
+    restoreOutput[0].valueRank = UA_VALUERANK_ONE_DIMENSION;
+    UA_Argument_init(&restoreOutput[1]);
+    restoreOutput[1].name = UA_STRING("Status");
+    restoreOutput[1].description = UA_LOCALIZEDTEXT("en_US", "status of every parameter, BadNotFound if missing in the snapshot");
+    restoreOutput[1].dataType = UA_TYPES[UA_TYPES_STATUSCODE].typeId;
+    restoreOutput[1].valueRank = UA_VALUERANK_ONE_DIMENSION;
+    method_attr = UA_MethodAttributes_default;
+    method_attr.description = UA_LOCALIZEDTEXT("en_US","restore the DSP and Calibration settings from nvram");
+    method_attr.displayName = UA_LOCALIZEDTEXT("en_US","RestoreSnapshot");
+    method_attr.executable = true;
+    method_attr.userExecutable = true;
+    UA_Server_addMethodNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_RESTORESNAPSHOT_ID),
+                            UA_NODEID_NUMERIC(1, LIBERA_DEVICE_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "RestoreSnapshot"),
+                            method_attr,
+                            &restoreSnapshot,
+                            1, &snapshotName,
+                            2, restoreOutput,
+                            NULL, NULL);
+    UA_Argument snapshotList;
+    UA_Argument_init(&snapshotList);
+    snapshotList.name = UA_STRING("Names");
+    snapshotList.description = UA_LOCALIZEDTEXT("en_US", "names of the stored snapshots");
+    snapshotList.dataType = UA_TYPES[UA_TYPES_STRING].typeId;
+    snapshotList.valueRank = UA_VALUERANK_ONE_DIMENSION;
+    method_attr = UA_MethodAttributes_default;
+    method_attr.description = UA_LOCALIZEDTEXT("en_US","list the snapshots stored in nvram");
+    method_attr.displayName = UA_LOCALIZEDTEXT("en_US","ListSnapshots");
+    method_attr.executable = true;
+    method_attr.userExecutable = true;
+    UA_Server_addMethodNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_LISTSNAPSHOTS_ID),
+                            UA_NODEID_NUMERIC(1, LIBERA_DEVICE_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "ListSnapshots"),
+                            method_attr,
+                            &listSnapshots,
+                            0, NULL,
+                            1, &snapshotList,
+                            NULL, NULL);
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","channel D calibration factor");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","KD");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calKDDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_kd,
-            .write = mci_set_cal_kd
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_KD_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "KD"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calKDDataSource,
-            NULL, NULL);
+    /**************************
+    Diagnostics
+    |   ResetLatency()
+    |   Read
+    |   |   Count
+    |   |   P50
+    |   |   P99
+    |   |   P999
+    |   |   Max
+    |   Decode
+    |   Enqueue
+    |   UdpSend
+    |   Publish
+    **************************/
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","position X calibration factor");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","LinearX");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calLinXDataSource = (UA_DataSource)
+    object_attr = UA_ObjectAttributes_default;
+    object_attr.description = UA_LOCALIZEDTEXT("en_US","latency of the records from the hardware time stamp to the stages of the data path");
+    object_attr.displayName = UA_LOCALIZEDTEXT("en_US","Diagnostics");
+    UA_Server_addObjectNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_DIAGNOSTICS_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                            UA_QUALIFIEDNAME(1, "Diagnostics"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            object_attr,
+                            NULL,
+                            NULL);
+    method_attr = UA_MethodAttributes_default;
+    method_attr.description = UA_LOCALIZEDTEXT("en_US","restart the latency statistics of all stages");
+    method_attr.displayName = UA_LOCALIZEDTEXT("en_US","ResetLatency");
+    method_attr.executable = true;
+    method_attr.userExecutable = true;
+    UA_Server_addMethodNode(server,
+                            UA_NODEID_NUMERIC(1, LIBERA_DIAG_RESET_ID),
+                            UA_NODEID_NUMERIC(1, LIBERA_DIAGNOSTICS_ID),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "ResetLatency"),
+                            method_attr,
+                            &resetLatency,
+                            0, NULL,
+                            0, NULL,
+                            NULL, NULL);
+    UA_DataSource diagnosticsDataSource = (UA_DataSource)
         {
-            .read = mci_get_cal_linx,
-            .write = mci_set_cal_linx
+            .read = readLatency,
+            .write = NULL
         };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_LINX_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "LinearX"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calLinXDataSource,
-            NULL, NULL);
-
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","position Y calibration factor");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","LinearY");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calLinYDataSource = (UA_DataSource)
+    // every stage has a folder with the statistics variables
+    for (size_t i=0; i<NUM_LATENCY_STAGES; i++)
+    {
+        latency_init(&latency_hist[i]);
+        UA_UInt32 folder = LIBERA_DIAG_STAGE_ID + LIBERA_DIAG_STAGE_STEP * i;
+        object_attr = UA_ObjectAttributes_default;
+        object_attr.description = UA_LOCALIZEDTEXT("en_US", (char *)latency_names[i]);
+        object_attr.displayName = UA_LOCALIZEDTEXT("en_US", (char *)latency_names[i]);
+        UA_Server_addObjectNode(server,
+                                UA_NODEID_NUMERIC(1, folder),
+                                UA_NODEID_NUMERIC(1, LIBERA_DIAGNOSTICS_ID),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                UA_QUALIFIEDNAME(1, (char *)latency_names[i]),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                                object_attr,
+                                NULL,
+                                NULL);
+        for (size_t k=0; k<NUM_LATENCY_VALUES; k++)
         {
-            .read = mci_get_cal_liny,
-            .write = mci_set_cal_liny
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_LINY_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "LinearY"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calLinYDataSource,
-            NULL, NULL);
+            attr = UA_VariableAttributes_default;
+            if (k == LATENCY_COUNT)
+            {
+                attr.description = UA_LOCALIZEDTEXT("en_US","number of records since the last reset");
+                attr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+            }
+            else
+            {
+                attr.description = UA_LOCALIZEDTEXT("en_US","latency percentile since the last reset [us]");
+                attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
+            }
+            attr.displayName = UA_LOCALIZEDTEXT("en_US", (char *)latency_values[k]);
+            attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+            UA_Server_addDataSourceVariableNode(
+                    server,
+                    UA_NODEID_NUMERIC(1, folder + LIBERA_DIAG_VALUE_STEP * (k+1)),
+                    UA_NODEID_NUMERIC(1, folder),
+                    UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                    UA_QUALIFIEDNAME(1, (char *)latency_values[k]),
+                    UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                    attr,
+                    diagnosticsDataSource,
+                    (void *)(uintptr_t)(i * NUM_LATENCY_VALUES + k), NULL);
+        }
+    }
+    if (UA_Server_addRepeatedCallback(server, dumpLatency, NULL, 200.0, NULL) != UA_STATUSCODE_GOOD)
+        Die("OpcUaServer : failed to install the latency dump callback");
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","shape Q calibration factor");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","LinearQ");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calLinQDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_linq,
-            .write = mci_set_cal_linq
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_LINQ_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "LinearQ"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calLinQDataSource,
-            NULL, NULL);
+    // the MCI folder, its contents are created when browsed
+    if (MirrorEnabled)
+        if (mirror_init(server, MirrorTTL, MirrorWritable) != 0)
+            Die("OpcUaServer : failed to create the MCI mirror");
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","sum calibration factor");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","LinearS");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calLinSDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_lins,
-            .write = mci_set_cal_lins
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_LINS_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "LinearS"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calLinSDataSource,
-            NULL, NULL);
+    // publish the values of new shots to the Signals/SP variables
+    if (UA_Server_addRepeatedCallback(server, publishValues, NULL, 1000.0 / PublishRate, NULL) != UA_STATUSCODE_GOOD)
+        Die("OpcUaServer : failed to install the publishing callback");
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","position X offset");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","OffsetX");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calOffXDataSource = (UA_DataSource)
+    // open the data stream
+    // the reader waits for data with poll(), read() must not block
+    // a unix socket (e.g. served by the streamgen tool) has to be connected
+    if ((stat(StreamDevice, &stat_buf) == 0) && S_ISSOCK(stat_buf.st_mode))
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, StreamDevice, sizeof(addr.sun_path)-1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if ((fd != -1) && (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0))
         {
-            .read = mci_get_cal_offx,
-            .write = mci_set_cal_offx
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_OFFX_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "OffsetX"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calOffXDataSource,
-            NULL, NULL);
+            close(fd);
+            fd = -1;
+        }
+    }
+    else
+        fd = open(StreamDevice, O_RDONLY | O_NONBLOCK);
+    if (fd == -1)
+    {
+        perror("OpcUaServer : open source stream");
+        Die("OpcUaServer : failed to open the source stream");
+    } else {
+        printf("OpcUaServer : opened %s with fd=%d\n", StreamDevice, fd);
+    };
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","position Y offset");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","OffsetY");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calOffYDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_offy,
-            .write = mci_set_cal_offy
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_OFFY_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "OffsetY"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calOffYDataSource,
-            NULL, NULL);
+    if (fstat(fd, &stat_buf) < 0)
+        Die("OpcUaServer : fstat() failure on the source stream");
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","shape Q offset");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","OffsetQ");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calOffQDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_offq,
-            .write = mci_set_cal_offq
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_OFFQ_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "OffsetQ"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calOffQDataSource,
-            NULL, NULL);
+    // create the shot history filled by the value stage
+    if (history_init(&SP_history, HistoryDepth) != 0)
+        Die("OpcUaServer : failed to allocate the shot history");
 
-    attr = UA_VariableAttributes_default;
-    attr.description = UA_LOCALIZEDTEXT("en_US","sum offset");
-    attr.displayName = UA_LOCALIZEDTEXT("en_US","OffsetS");
-    attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_DataSource calOffSDataSource = (UA_DataSource)
-        {
-            .read = mci_get_cal_offs,
-            .write = mci_set_cal_offs
-        };
-    UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_OFFS_ID),
-            UA_NODEID_NUMERIC(1, LIBERA_CAL_ID),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, "OffsetS"),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            calOffSDataSource,
-            NULL, NULL);
+    // no page faults while streaming, the buffers allocated later are locked as well
+    if (LockMemory)
+        if (rt_lock_memory() != 0)
+            fprintf(stderr, "OpcUaServer : failed to lock the memory, continuing without\n");
 
-    // open the data stream
-    fd = open("/dev/libera.strm0", O_RDONLY);
-    if (fd == -1)
+    // create the ring buffer and start the consumer stages
+    if (ring_init(&stream_ring, StreamRingRecords) != 0)
+        Die("OpcUaServer : failed to allocate the ring buffer");
+    for (size_t i=0; i<NUM_STREAM_STAGES; i++)
     {
-        Die("OpcUaServer : failed to open /dev/libera.strm0");
-    } else {
-        printf("OpcUaServer : opened /dev/libera.strm0 with fd=%d\n",fd);
+        ring_reader_init(&stream_stages[i].reader, &stream_ring);
+        if (0 != rt_thread_create(&stream_stages[i].tid, stream_stages[i].name, &stream_stages[i].rt, &consumeStream, (void *)&stream_stages[i]))
+            Die("OpcUaServer : failed to create consumer thread");
     };
+    printf("OpcUaServer : %d consumer threads created successfully\n", (int)NUM_STREAM_STAGES);
 
-    if (fstat(fd, &stat_buf) < 0)
-        Die("OpcUaServer : fstat() failure on /dev/libera.strm0");
+    // the stream reader waits on this for the shutdown
+    StreamStopFd = eventfd(0, EFD_CLOEXEC);
+    if (StreamStopFd < 0)
+        Die("OpcUaServer : failed to create the stream shutdown eventfd");
 
     // fork off a thread that reads the stream data
     pthread_t tid;
-    // int pthread_create(
-    //      pthread_t *thread,
-    //      const pthread_attr_t *attr,
-    //      void *(*start_routine) (void *),
-    //      void *arg);
-    if (0 != pthread_create(&tid, NULL, &readStream, (void *)&fd))
+    jitter_init(&ArrivalJitter);
+    if (0 != rt_thread_create(&tid, "reader", &ReaderThread, &readStream, (void *)&fd))
         Die("OpcUaServer : failed to create read thread");
     else
         printf("OpcUaServer : read thread created successfully\n");
@@ -1586,15 +2860,26 @@ int main(int argc, char *argv[])
     printf("OpcUaServer : stopped running.\n");
 
     // wait for the read thread to exit
+    running = false;
+    stopStream();
     pthread_join(tid, NULL);
+    close(StreamStopFd);
+    // wait for the consumer threads to exit
+    for (size_t i=0; i<NUM_STREAM_STAGES; i++)
+        pthread_join(stream_stages[i].tid, NULL);
+    ring_free(&stream_ring);
+    history_free(&SP_history);
 
     status = close(fd);
     if (-1==status) perror("OpcUaServer : close source stream");
     else printf("OpcUaServer : data stream closed.\n");
 
-    if (StreamTransmit) closeStreamUDP();
+    // the UDP stage has exited, its stream can be closed here
+    if (UdpOpen) closeStreamUDP();
 
     mci_shutdown();
+    // after the MCI worker, which may still be browsing
+    mirror_free();
 
     printf("OpcUaServer : graceful exit\n");
     return (int)retval;
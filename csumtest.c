@@ -0,0 +1,129 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file csumtest.c
+  OpcUaStreamServer : check of the vectorized checksum sum
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+
+  This program compares csum_partial() from libera_udp.c with a plain scalar
+  loop for buffers of random length, alignment, content and start sum, and for
+  buffers filled with 0xff, which drive the vector lanes to their largest sums.
+  On the host "make csumtest" builds it with a portable model of the NEON
+  intrinsics (libera_neon_model.h). Built with the cross compiler it checks
+  the real NEON code, e.g. under qemu-arm.
+
+  usage: csumtest [count] [seed]
+    count        number of random buffers (default 20000)
+    seed         seed of the random number generator (default 1)
+
+  The exit status is 0 if all sums agree.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "libera_udp.h"
+
+// large enough for several of the 4096 block runs of the vector loop
+#define MAX_LENGTH 300000
+#define MAX_OFFSET 16
+
+static unsigned char buffer[MAX_LENGTH + MAX_OFFSET] __attribute__((aligned(16)));
+
+// the scalar loop of csum_partial(), the words are read bytewise
+// so the reference does not depend on the alignment of the buffer
+static uint32_t reference_sum(const unsigned char *ptr, int nbytes, uint32_t sum)
+{
+    uint64_t acc = sum;
+    unsigned short word;
+    while(nbytes>1) {
+        memcpy(&word, ptr, 2);
+        acc+=word;
+        ptr+=2;
+        nbytes-=2;
+    }
+    if(nbytes==1) {
+        word=0;
+        *((unsigned char*)&word)=*ptr;
+        acc+=word;
+    }
+    acc = (acc>>32)+(acc & 0xffffffff);
+    acc = (acc>>32)+(acc & 0xffffffff);
+    return (uint32_t)acc;
+}
+
+// returns true if both sums agree
+static int check(int offset, int nbytes, uint32_t sum)
+{
+    uint32_t ref = reference_sum(buffer + offset, nbytes, sum);
+    uint32_t res = csum_partial((const unsigned short *)(buffer + offset), nbytes, sum);
+    if (res == ref)
+        return 1;
+    printf("csumtest : mismatch at offset %d length %d sum %08x : %08x instead of %08x\n",
+        offset, nbytes, sum, res, ref);
+    return 0;
+}
+
+static uint32_t random32()
+{
+    return ((uint32_t)(rand() & 0xffff) << 16) | (uint32_t)(rand() & 0xffff);
+}
+
+int main(int argc, char *argv[])
+{
+    long count = 20000;
+    unsigned int seed = 1;
+    if (argc > 3)
+    {
+        printf("usage: csumtest [count] [seed]\n");
+        exit(1);
+    }
+    if (argc > 1)
+        count = atol(argv[1]);
+    if (argc > 2)
+        seed = (unsigned int)strtoul(argv[2], NULL, 0);
+    srand(seed);
+    int failed = 0;
+    // the largest lane sums, every word is 0xffff
+    memset(buffer, 0xff, sizeof(buffer));
+    for (int offset=0; offset<MAX_OFFSET; offset++)
+    {
+        failed += !check(offset, MAX_LENGTH, 0);
+        failed += !check(offset, MAX_LENGTH, 0xffffffff);
+        failed += !check(offset, 1500, 0xffffffff);
+    }
+    for (long i=0; i<count; i++)
+    {
+        int offset = rand() % MAX_OFFSET;
+        // mostly packet sizes, some buffers longer than one run of the vector loop
+        int nbytes = (i % 100 == 0) ? rand() % MAX_LENGTH : rand() % 1600;
+        for (int k=0; k<nbytes; k++)
+            buffer[offset+k] = (unsigned char)rand();
+        failed += !check(offset, nbytes, random32());
+    }
+    printf("csumtest : %ld random buffers (seed %u), %d mismatches\n", count, seed, failed);
+    return failed ? 1 : 0;
+}
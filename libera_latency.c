@@ -0,0 +1,128 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_latency.c
+  OpcUaStreamServer : histograms of the latency of the stream records
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <time.h>
+
+#include "libera_latency.h"
+
+void latency_init(LatencyHistogram *hist)
+{
+    memset(hist, 0, sizeof(LatencyHistogram));
+}
+
+uint64_t latency_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// the bucket of a latency [ns]
+static int latency_bucket(uint64_t ns)
+{
+    if (ns < (1ULL << LATENCY_MIN_SHIFT))
+        return 0;
+    int msb = 63 - __builtin_clzll(ns);
+    int sub = (int)(ns >> (msb - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+    int bucket = 1 + ((msb - LATENCY_MIN_SHIFT) << LATENCY_SUB_BITS) + sub;
+    return (bucket < LATENCY_BUCKETS) ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// the upper limit of a bucket [ns]
+static uint64_t latency_limit(int bucket)
+{
+    if (bucket == 0)
+        return 1ULL << LATENCY_MIN_SHIFT;
+    int octave = (bucket - 1) >> LATENCY_SUB_BITS;
+    int sub = (bucket - 1) & ((1 << LATENCY_SUB_BITS) - 1);
+    return (uint64_t)((1 << LATENCY_SUB_BITS) + sub + 1) << (octave + LATENCY_MIN_SHIFT - LATENCY_SUB_BITS);
+}
+
+void latency_add(LatencyHistogram *hist, uint64_t time, uint64_t now)
+{
+    if (time == 0)
+        return;
+    // a time stamp in the future counts as no latency
+    uint64_t ns = (now > time) ? now - time : 0;
+    int bucket = latency_bucket(ns);
+    // the only writer, so no read-modify-write is needed
+    __atomic_store_n(&hist->count[bucket], hist->count[bucket] + 1, __ATOMIC_RELAXED);
+    if (ns > __atomic_load_n(&hist->max, __ATOMIC_RELAXED))
+        __atomic_store_n(&hist->max, ns, __ATOMIC_RELAXED);
+}
+
+// the upper limit of the bucket holding the given fraction of all records [us]
+static double latency_percentile(const uint32_t *counts, uint64_t total, double fraction, uint64_t max)
+{
+    if (total == 0)
+        return 0.0;
+    uint64_t rank = (uint64_t)(fraction * total);
+    if (rank >= total) rank = total - 1;
+    uint64_t sum = 0;
+    for (int i=0; i<LATENCY_BUCKETS; i++)
+    {
+        sum += counts[i];
+        if (sum > rank)
+        {
+            uint64_t limit = latency_limit(i);
+            // the bucket of the maximum is not filled to its limit
+            return 1.e-3 * (double)((limit < max) ? limit : max);
+        }
+    }
+    return 1.e-3 * (double)max;
+}
+
+void latency_stats(LatencyHistogram *hist, LatencyStats *stats)
+{
+    uint32_t counts[LATENCY_BUCKETS];
+    uint64_t total = 0;
+    for (int i=0; i<LATENCY_BUCKETS; i++)
+    {
+        // the counters may wrap around, the difference stays correct
+        counts[i] = __atomic_load_n(&hist->count[i], __ATOMIC_RELAXED) - hist->baseline[i];
+        total += counts[i];
+    }
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    stats->count = total;
+    stats->p50 = latency_percentile(counts, total, 0.5, max);
+    stats->p99 = latency_percentile(counts, total, 0.99, max);
+    stats->p999 = latency_percentile(counts, total, 0.999, max);
+    stats->max = (total > 0) ? 1.e-3 * (double)max : 0.0;
+}
+
+void latency_reset(LatencyHistogram *hist)
+{
+    for (int i=0; i<LATENCY_BUCKETS; i++)
+        hist->baseline[i] = __atomic_load_n(&hist->count[i], __ATOMIC_RELAXED);
+    // a record arriving meanwhile may restore a larger maximum, which is harmless
+    __atomic_store_n(&hist->max, 0, __ATOMIC_RELAXED);
+}
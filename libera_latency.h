@@ -0,0 +1,97 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_latency.h
+  OpcUaStreamServer : histograms of the latency of the stream records
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERALATENCY_H
+#define LIBERALATENCY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    The latency of a record at some stage of the data path is the time
+    since its hardware time stamp (record->time, ns since the epoch).
+    It is recorded in a histogram with logarithmic buckets, 4 per octave
+    from 1 us to 68 s, so a percentile is known within 19%.
+
+    Every histogram has a single writer (the thread of the stage), which
+    only increments counters, so there is no allocation and no locking
+    on the hot path. Readers take the counters with atomic loads. A reset
+    copies the counters as baseline, which is subtracted afterwards, so
+    the writer never has to be stopped.
+
+    The time stamps of the FPGA are taken from the same clock as the system
+    time of the device. On a host fed by streamgen the records are stamped
+    with the system time of the generator.
+*/
+
+// values below 2^LATENCY_MIN_SHIFT ns (1 us) go into bucket 0
+#define LATENCY_MIN_SHIFT 10
+#define LATENCY_SUB_BITS 2
+#define LATENCY_OCTAVES 26
+#define LATENCY_BUCKETS (1 + (LATENCY_OCTAVES << LATENCY_SUB_BITS))
+
+typedef struct {
+    uint32_t count[LATENCY_BUCKETS];
+    uint64_t max;               // [ns]
+    // the counters at the time of the last reset, only used by the reader
+    uint32_t baseline[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+// the percentiles reported
+typedef struct {
+    uint64_t count;             // number of records since the reset
+    double p50;                 // [us]
+    double p99;
+    double p999;
+    double max;
+} LatencyStats;
+
+void latency_init(LatencyHistogram *hist);
+
+// the current system time [ns since the epoch]
+uint64_t latency_now();
+
+// add the latency of a record with the hardware time stamp time at the given time now [ns]
+// records without time stamp are ignored
+void latency_add(LatencyHistogram *hist, uint64_t time, uint64_t now);
+
+// evaluate the histogram since the last reset
+void latency_stats(LatencyHistogram *hist, LatencyStats *stats);
+
+// restart the statistics, has to be called from the reading thread
+void latency_reset(LatencyHistogram *hist);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
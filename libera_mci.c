@@ -30,1018 +30,1085 @@ SOFTWARE.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <signal.h>
-
-#include "mci/mci.h"
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <deque>
+#include <vector>
 
 #include "libera_mci.h"
+#include "libera_nodes.h"
 
-// global variables for persistent access
-mci::Node node_root;
-mci::Node node_dev_freq;
-mci::Node node_dsp_enable;
-mci::Node node_dsp_thr1;
-mci::Node node_dsp_pre;
-mci::Node node_dsp_post1;
-mci::Node node_dsp_timeout;
-mci::Node node_dsp_averaging;
-mci::Node node_maxadc;
-mci::Node node_cal_attenuation;
-mci::Node node_cal_ka;
-mci::Node node_cal_kb;
-mci::Node node_cal_kc;
-mci::Node node_cal_kd;
-mci::Node node_cal_linx;
-mci::Node node_cal_liny;
-mci::Node node_cal_linq;
-mci::Node node_cal_lins;
-mci::Node node_cal_offx;
-mci::Node node_cal_offy;
-mci::Node node_cal_offq;
-mci::Node node_cal_offs;
+/*
+    Every MCI access is a round trip to the LiberaBase application.
+    To keep the OPC-UA server loop responsive, no MCI calls are made from
+    the datasource routines. All MCI accesses are done by a worker thread
+    which processes a queue of requests.
 
-int mci_error;
+    A read of a parameter is answered from the cached value. Every parameter
+    has a time-to-live, a read of a value older than that counts as a cache
+    miss and queues a refresh. Parameters which have been read by a client
+    are refreshed by the worker in the background before their TTL expires,
+    so repeated reads (e.g. by a HMI panel) are answered without MCI calls.
+    A write updates the cached value immediately (write-through) and queues
+    the write to the device. If writing fails, the value is read back from
+    the device to restore the cache.
 
-int mci_init()
-{
-    mci::Init();
-    // connect to LiberaBase application running on local host
-    node_root = mci::Connect();
-    if (node_root.IsValid())
-    {
-        printf("MCI connect OK\n");
-        mci_error = 0;
-    } else {
-        printf("MCI error : can't connect\n");
-        mci_error = 1;
-    }
-    node_dev_freq = node_root.GetNode(mci::Tokenize("application.clock_info.adc_frequency"));
-    if (!node_dev_freq.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.clock_info.adc_frequency\n");
-    };
-    node_dsp_enable = node_root.GetNode(mci::Tokenize("application.dsp.enable"));
-    if (!node_dsp_enable.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.dsp.enable\n");
-    };
-    node_dsp_thr1 = node_root.GetNode(mci::Tokenize("application.dsp.bunch_thr1"));
-    if (!node_dsp_thr1.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.dsp.bunch_thr1\n");
-    };
-    node_dsp_pre = node_root.GetNode(mci::Tokenize("application.dsp.pre_trigger"));
-    if (!node_dsp_pre.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.dsp.pre_trigger\n");
-    };
-    node_dsp_post1 = node_root.GetNode(mci::Tokenize("application.dsp.post_trigger1"));
-    if (!node_dsp_post1.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.dsp.post_trigger1\n");
-    };
-    node_dsp_timeout = node_root.GetNode(mci::Tokenize("application.dsp.scan_timeout"));
-    if (!node_dsp_timeout.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.dsp.scan_timeout\n");
-    };
-    node_dsp_averaging = node_root.GetNode(mci::Tokenize("application.dsp.data_averaging"));
-    if (!node_dsp_averaging.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.dsp.data_averaging\n");
-    };
-    node_maxadc = node_root.GetNode(mci::Tokenize("application.input.max_adc"));
-    if (!node_maxadc.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.input.max_adc\n");
-    };
-    node_cal_attenuation = node_root.GetNode(mci::Tokenize("application.attenuation.att_id"));
-    if (!node_cal_attenuation.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.attenuation.att_id\n");
-    };
-    node_cal_ka = node_root.GetNode(mci::Tokenize("application.calibration.ka"));
-    if (!node_cal_ka.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.ka\n");
-    };
-    node_cal_kb = node_root.GetNode(mci::Tokenize("application.calibration.kb"));
-    if (!node_cal_kb.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.kb\n");
-    };
-    node_cal_kc = node_root.GetNode(mci::Tokenize("application.calibration.kc"));
-    if (!node_cal_kc.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.kc\n");
-    };
-    node_cal_kd = node_root.GetNode(mci::Tokenize("application.calibration.kd"));
-    if (!node_cal_kd.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.kd\n");
-    };
-    node_cal_linx = node_root.GetNode(mci::Tokenize("application.calibration.linear.x.k"));
-    if (!node_cal_linx.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.linear.x.k\n");
-    };
-    node_cal_liny = node_root.GetNode(mci::Tokenize("application.calibration.linear.y.k"));
-    if (!node_cal_liny.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.linear.y.k\n");
-    };
-    node_cal_linq = node_root.GetNode(mci::Tokenize("application.calibration.linear.q.k"));
-    if (!node_cal_linq.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.linear.q.k\n");
-    };
-    node_cal_lins = node_root.GetNode(mci::Tokenize("application.calibration.linear.sum.k"));
-    if (!node_cal_lins.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.linear.sum.k\n");
-    };
-    node_cal_offx = node_root.GetNode(mci::Tokenize("application.calibration.linear.x.offs"));
-    if (!node_cal_offx.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.linear.x.offs\n");
-    };
-    node_cal_offy = node_root.GetNode(mci::Tokenize("application.calibration.linear.y.offs"));
-    if (!node_cal_offy.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.linear.y.offs\n");
-    };
-    node_cal_offq = node_root.GetNode(mci::Tokenize("application.calibration.linear.q.offs"));
-    if (!node_cal_offq.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.linear.q.offs\n");
-    };
-    node_cal_offs = node_root.GetNode(mci::Tokenize("application.calibration.linear.sum.offs"));
-    if (!node_cal_offs.IsValid())
-    {
-        mci_error = 2;
-        printf("MCI node error : application.calibration.linear.sum.offs\n");
-    };
-    return(mci_error);
-}
+    Reads are processed in batches. The worker collects the refresh requests
+    arriving within a short window (e.g. all nodes of a multi-node read
+    request) and refreshes them together with their siblings in the same
+    folder which are halfway to expiry. A client loading the whole
+    Calibration folder thus causes one worker pass instead of one per node
+    and the following reads of that folder are all cache hits.
+*/
 
-int mci_shutdown()
-{
-    mci::Shutdown();
-    printf("MCI shutdown OK\n");
-    return(0);
-}
+// the values of the MCI parameters
+union MciValue {
+    bool b;
+    int32_t l;
+    unsigned int u;
+    int64_t i;
+    uint64_t ul;
+    double d;
+};
 
-UA_StatusCode mci_get_dev_freq(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
-{
-    unsigned int val;
-    if(node_dev_freq.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_UInt32*)(&val), &UA_TYPES[UA_TYPES_UINT32]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.clock_info.adc_frequency\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
-}
+// the registry of all parameters, the order defines the order of the nodes
+// TTL [ms] : the measured max_adc changes all the time, the calibration only when edited
+#define MCI_RW (UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE)
+static const MciParamInfo mci_registry[] = {
+    { "application.clock_info.adc_frequency", LIBERA_DEVFREQ_ID, LIBERA_DEVICE_ID,
+      "SampleFreq", "ADC sample frequency", UA_TYPES_UINT32, UA_ACCESSLEVELMASK_READ, 10000 },
+    { "application.input.max_adc", LIBERA_MAXADC_ID, LIBERA_SIGNALS_ID,
+      "MaxADC", "maximum ADC value", UA_TYPES_UINT32, UA_ACCESSLEVELMASK_READ, 200 },
+    { "application.dsp.enable", LIBERA_DSP_ENABLE_ID, LIBERA_DSP_ID,
+      "DspEnable", "DSP enable", UA_TYPES_BOOLEAN, MCI_RW, 1000 },
+    { "application.dsp.bunch_thr1", LIBERA_DSP_THR1_ID, LIBERA_DSP_ID,
+      "DspThr1", "DSP bunch threshold 1", UA_TYPES_UINT32, MCI_RW, 1000 },
+    { "application.dsp.pre_trigger", LIBERA_DSP_PRE_ID, LIBERA_DSP_ID,
+      "DspPre", "DSP number of pre-trigger samples", UA_TYPES_UINT32, MCI_RW, 1000 },
+    { "application.dsp.post_trigger1", LIBERA_DSP_POST1_ID, LIBERA_DSP_ID,
+      "DspPost1", "DSP number of samples for first frame", UA_TYPES_UINT32, MCI_RW, 1000 },
+    { "application.dsp.scan_timeout", LIBERA_DSP_TIMEOUT_ID, LIBERA_DSP_ID,
+      "DspTimeout", "DSP scan timeout", UA_TYPES_UINT32, MCI_RW, 1000 },
+    { "application.dsp.data_averaging", LIBERA_DSP_AVERAGING_ID, LIBERA_DSP_ID,
+      "DspAveraging", "DSP averaging", UA_TYPES_UINT32, MCI_RW, 1000 },
+    { "application.attenuation.att_id", LIBERA_CAL_ATT_ID, LIBERA_CAL_ID,
+      "Attenuation", "attenuator setting", UA_TYPES_UINT32, MCI_RW, 5000 },
+    { "application.calibration.ka", LIBERA_CAL_KA_ID, LIBERA_CAL_ID,
+      "KA", "channel A calibration factor", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.kb", LIBERA_CAL_KB_ID, LIBERA_CAL_ID,
+      "KB", "channel B calibration factor", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.kc", LIBERA_CAL_KC_ID, LIBERA_CAL_ID,
+      "KC", "channel C calibration factor", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.kd", LIBERA_CAL_KD_ID, LIBERA_CAL_ID,
+      "KD", "channel D calibration factor", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.linear.x.k", LIBERA_CAL_LINX_ID, LIBERA_CAL_ID,
+      "LinearX", "position X calibration factor", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.linear.y.k", LIBERA_CAL_LINY_ID, LIBERA_CAL_ID,
+      "LinearY", "position Y calibration factor", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.linear.q.k", LIBERA_CAL_LINQ_ID, LIBERA_CAL_ID,
+      "LinearQ", "shape Q calibration factor", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.linear.sum.k", LIBERA_CAL_LINS_ID, LIBERA_CAL_ID,
+      "LinearS", "sum calibration factor", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.linear.x.offs", LIBERA_CAL_OFFX_ID, LIBERA_CAL_ID,
+      "OffsetX", "position X offset", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.linear.y.offs", LIBERA_CAL_OFFY_ID, LIBERA_CAL_ID,
+      "OffsetY", "position Y offset", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.linear.q.offs", LIBERA_CAL_OFFQ_ID, LIBERA_CAL_ID,
+      "OffsetQ", "shape Q offset", UA_TYPES_DOUBLE, MCI_RW, 5000 },
+    { "application.calibration.linear.sum.offs", LIBERA_CAL_OFFS_ID, LIBERA_CAL_ID,
+      "OffsetS", "sum offset", UA_TYPES_DOUBLE, MCI_RW, 5000 }
+};
+#define MCI_NUM_PARAMS ((int)(sizeof(mci_registry)/sizeof(mci_registry[0])))
 
-UA_StatusCode mci_get_dsp_enable(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// the cache state of a parameter
+// the first entries belong to the registry, mirrored parameters are appended by the worker
+struct MciTypeOps;
+struct MciParam {
+    const MciParamInfo *info;
+    mci::Node node;
+    const MciTypeOps *ops;   // device access routines, resolved with the node
+    MciValue value;         // last value read from or written to the device
+    uint64_t updated;       // time of the last update [ms monotonic]
+    bool valid;             // the value has been read from the device
+    bool accessed;          // read by a client since the last refresh
+    bool failed;            // the last refresh has failed
+    bool read_pending;      // a refresh is queued
+    int write_pending;      // number of writes queued
+};
+// only the worker thread appends entries, all other threads access the cache under mci_lock
+static std::deque<MciParam> mci_params;
+
+// a parameter added at run time, info has to be the first member
+struct MciDynParam {
+    MciParamInfo info;
+    int index;
+};
+
+/*
+    Type handling : MciType<T> maps a C++ type to its member in MciValue
+    and its OPC-UA type. The templated routines below are instantiated
+    once per type and selected by the type of the parameter.
+*/
+
+template<typename T> struct MciType;
+template<> struct MciType<bool> {
+    static const int ua_type = UA_TYPES_BOOLEAN;
+    static bool &ref(MciValue &v) { return v.b; }
+};
+template<> struct MciType<int32_t> {
+    static const int ua_type = UA_TYPES_INT32;
+    static int32_t &ref(MciValue &v) { return v.l; }
+};
+template<> struct MciType<unsigned int> {
+    static const int ua_type = UA_TYPES_UINT32;
+    static unsigned int &ref(MciValue &v) { return v.u; }
+};
+template<> struct MciType<int64_t> {
+    static const int ua_type = UA_TYPES_INT64;
+    static int64_t &ref(MciValue &v) { return v.i; }
+};
+template<> struct MciType<uint64_t> {
+    static const int ua_type = UA_TYPES_UINT64;
+    static uint64_t &ref(MciValue &v) { return v.ul; }
+};
+template<> struct MciType<double> {
+    static const int ua_type = UA_TYPES_DOUBLE;
+    static double &ref(MciValue &v) { return v.d; }
+};
+
+// read the value from the device
+// MCI throws if the connection to LiberaBase is broken, this is reported as failure
+template<typename T> static bool mci_fetch(mci::Node &node, MciValue &val)
 {
-    bool val;
-    if(node_dsp_enable.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Boolean*)(&val), &UA_TYPES[UA_TYPES_BOOLEAN]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.dsp.enable\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+    if (!node.IsValid())
+        return false;
+    try {
+        return node.GetValue(MciType<T>::ref(val));
+    } catch (...) {
+        return false;
     }
 }
 
-UA_StatusCode mci_set_dsp_enable(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// write the value to the device
+template<typename T> static bool mci_store(mci::Node &node, MciValue &val)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN]) && (data->value.data != 0))
-    {
-        bool val = *(bool*)data->value.data;
-        if(node_dsp_enable.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.dsp.enable\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_dsp_enable\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+    if (!node.IsValid())
+        return false;
+    try {
+        return node.SetValue(MciType<T>::ref(val));
+    } catch (...) {
+        return false;
     }
 }
 
-UA_StatusCode mci_get_dsp_thr1(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// copy the value into an OPC-UA variant
+template<typename T> static void mci_to_variant(MciValue &val, UA_Variant *variant)
 {
-    unsigned int val;
-    if(node_dsp_thr1.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_UInt32*)(&val), &UA_TYPES[UA_TYPES_UINT32]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.dsp.bunch_thr1\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    UA_Variant_setScalarCopy(variant, &MciType<T>::ref(val), &UA_TYPES[MciType<T>::ua_type]);
 }
 
-UA_StatusCode mci_set_dsp_thr1(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// get the value from an OPC-UA variant, returns false if the type does not match
+template<typename T> static bool mci_from_variant(const UA_Variant *variant, MciValue &val)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_UINT32]) && (data->value.data != 0))
-    {
-        unsigned int val = *(unsigned int*)data->value.data;
-        if(node_dsp_thr1.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.dsp.bunch_thr1\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_dsp_thr1\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    if (!UA_Variant_isScalar(variant) || (variant->type != &UA_TYPES[MciType<T>::ua_type]) || (variant->data == 0))
+        return false;
+    MciType<T>::ref(val) = *(T*)variant->data;
+    return true;
 }
 
-UA_StatusCode mci_get_dsp_pre(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// compare a value read back from the device with the value written
+template<typename T> static bool mci_equal(MciValue &a, MciValue &b)
 {
-    unsigned int val;
-    if(node_dsp_pre.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_UInt32*)(&val), &UA_TYPES[UA_TYPES_UINT32]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.dsp.pre_trigger\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    return MciType<T>::ref(a) == MciType<T>::ref(b);
 }
 
-UA_StatusCode mci_set_dsp_pre(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// the device may round floating point values
+template<> bool mci_equal<double>(MciValue &a, MciValue &b)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_UINT32]) && (data->value.data != 0))
-    {
-        unsigned int val = *(unsigned int*)data->value.data;
-        if(node_dsp_pre.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.dsp.pre_trigger\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_dsp_pre\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    return fabs(a.d - b.d) <= 1.e-9 * fmax(fabs(a.d), fabs(b.d));
 }
 
-UA_StatusCode mci_get_dsp_post1(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// the routines for one type
+struct MciTypeOps {
+    bool (*fetch)(mci::Node &node, MciValue &val);
+    bool (*store)(mci::Node &node, MciValue &val);
+    void (*to_variant)(MciValue &val, UA_Variant *variant);
+    bool (*from_variant)(const UA_Variant *variant, MciValue &val);
+    bool (*equal)(MciValue &a, MciValue &b);
+};
+
+template<typename T> static const MciTypeOps *mci_ops_of()
 {
-    unsigned int val;
-    if(node_dsp_post1.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_UInt32*)(&val), &UA_TYPES[UA_TYPES_UINT32]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.dsp.post_trigger1\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    static const MciTypeOps ops = { mci_fetch<T>, mci_store<T>, mci_to_variant<T>, mci_from_variant<T>, mci_equal<T> };
+    return &ops;
 }
 
-UA_StatusCode mci_set_dsp_post1(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// read a device value of type D into a parameter of type T
+// values which cannot be represented in T are reported as failure
+template<typename D, typename T> static bool mci_fetch_as(mci::Node &node, MciValue &val)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_UINT32]) && (data->value.data != 0))
-    {
-        unsigned int val = *(unsigned int*)data->value.data;
-        if(node_dsp_post1.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.dsp.post_trigger1\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_dsp_post1\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    if (!node.IsValid())
+        return false;
+    D dev;
+    try {
+        if (!node.GetValue(dev))
+            return false;
+    } catch (...) {
+        return false;
+    }
+    MciType<T>::ref(val) = (T)dev;
+    return (D)MciType<T>::ref(val) == dev;
 }
 
-UA_StatusCode mci_get_dsp_timeout(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// write a parameter of type T to a device value of type D
+template<typename D, typename T> static bool mci_store_as(mci::Node &node, MciValue &val)
 {
-    unsigned int val;
-    if(node_dsp_timeout.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_UInt32*)(&val), &UA_TYPES[UA_TYPES_UINT32]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.dsp.scan_timeout\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+    if (!node.IsValid())
+        return false;
+    D dev = (D)MciType<T>::ref(val);
+    try {
+        return node.SetValue(dev);
+    } catch (...) {
+        return false;
     }
 }
 
-UA_StatusCode mci_set_dsp_timeout(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// the routines for a parameter of type T held by the device as type D
+template<typename D, typename T> static const MciTypeOps *mci_ops_as()
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_UINT32]) && (data->value.data != 0))
-    {
-        unsigned int val = *(unsigned int*)data->value.data;
-        if(node_dsp_timeout.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.dsp.scan_timeout\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_dsp_timeout\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    static const MciTypeOps ops = { mci_fetch_as<D,T>, mci_store_as<D,T>, mci_to_variant<T>, mci_from_variant<T>, mci_equal<T> };
+    return &ops;
 }
 
-UA_StatusCode mci_get_dsp_averaging(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// the routines for a parameter type given as index into UA_TYPES
+static const MciTypeOps *mci_ops(int type)
 {
-    unsigned int val;
-    if(node_dsp_averaging.GetValue(val))
+    switch (type)
     {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_UInt32*)(&val), &UA_TYPES[UA_TYPES_UINT32]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.dsp.data_averaging\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        case UA_TYPES_BOOLEAN : return mci_ops_of<bool>();
+        case UA_TYPES_INT32 : return mci_ops_of<int32_t>();
+        case UA_TYPES_UINT32 : return mci_ops_of<unsigned int>();
+        case UA_TYPES_INT64 : return mci_ops_of<int64_t>();
+        case UA_TYPES_UINT64 : return mci_ops_of<uint64_t>();
+        case UA_TYPES_DOUBLE : return mci_ops_of<double>();
     }
+    return NULL;
 }
 
-UA_StatusCode mci_set_dsp_averaging(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// the routines for a parameter whose device node has a different type
+// the node type is part of the client interface and kept when the device changes
+// (Attenuation is UInt32 on the server and a long long in the device)
+static const MciTypeOps *mci_ops(int type, int device_type)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_UINT32]) && (data->value.data != 0))
-    {
-        unsigned int val = *(unsigned int*)data->value.data;
-        if(node_dsp_averaging.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.dsp.data_averaging\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_dsp_averaging\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    if ((type == UA_TYPES_UINT32) && (device_type == UA_TYPES_INT64))
+        return mci_ops_as<int64_t, unsigned int>();
+    return NULL;
 }
 
-UA_StatusCode mci_get_maxadc(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// the index of a parameter in the cache
+static int mci_index(const MciParamInfo *info)
 {
-    unsigned int val;
-    if(node_maxadc.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_UInt32*)(&val), &UA_TYPES[UA_TYPES_UINT32]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.input.max_adc\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    if ((info >= mci_registry) && (info < mci_registry + MCI_NUM_PARAMS))
+        return (int)(info - mci_registry);
+    return ((const MciDynParam *)info)->index;
 }
 
-UA_StatusCode mci_get_cal_attenuation(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// the kinds of requests for the worker
+enum { MCI_REQ_READ, MCI_REQ_WRITE, MCI_REQ_JOB };
+
+// a request for the MCI worker thread
+struct MciRequest {
+    int kind;
+    int param;
+    MciValue value;
+    void (*job)(void *arg);
+    // optional, called with mci_lock held instead of the job when it is dropped at shutdown
+    void (*discard)(void *arg);
+    void *arg;
+};
+
+#define MCI_QUEUE_SIZE 256
+
+// the request queue, protected by mci_lock
+static MciRequest mci_queue[MCI_QUEUE_SIZE];
+static unsigned int mci_queue_head = 0;     // next request to be processed
+static unsigned int mci_queue_tail = 0;     // next free entry
+static pthread_mutex_t mci_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mci_cond;
+// signals the completion of jobs to threads waiting for them
+static pthread_cond_t mci_done_cond;
+static bool mci_worker_running = false;
+static pthread_t mci_worker_tid;
+
+// maximum time the worker sleeps when there is nothing to do [ms]
+#define MCI_IDLE_MS 1000
+
+// time the worker waits for more reads before processing a batch [ms]
+#define MCI_BATCH_MS 2
+
+// the connection watchdog : when the connection is found broken, the worker
+// tries to reconnect with an exponentially growing interval
+#define MCI_RECONNECT_MIN_MS 500
+#define MCI_RECONNECT_MAX_MS 30000
+// the connection is checked if there has been no successful MCI call for that time [ms]
+#define MCI_HEALTH_MS 5000
+
+// connection state, protected by mci_lock
+static bool mci_connected = false;
+static uint32_t mci_reconnects = 0;
+static unsigned int mci_backoff = MCI_RECONNECT_MIN_MS;
+static uint64_t mci_reconnect_due = 0;      // time of the next reconnect attempt [ms monotonic]
+static uint64_t mci_last_ok = 0;            // time of the last successful MCI call [ms monotonic]
+
+// cache statistics, protected by mci_lock
+static uint64_t mci_cache_hits = 0;
+static uint64_t mci_cache_misses = 0;
+static uint64_t mci_batches = 0;
+static uint64_t mci_batch_reads = 0;
+
+// monotonic time in ms
+static uint64_t mci_now_ms()
 {
-    int64_t val;
-    if(node_cal_attenuation.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Int64*)(&val), &UA_TYPES[UA_TYPES_INT64]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.attenuation.att_id\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
 
-UA_StatusCode mci_set_cal_attenuation(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// global variables for persistent access
+mci::Node node_root;
+
+int mci_error;
+
+// append a request to the queue, mci_lock has to be held
+// returns false if the queue is full
+static bool mci_enqueue(int kind, int param, const MciValue *val)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_INT64]) && (data->value.data != 0))
-    {
-        int64_t val = *(int64_t*)data->value.data;
-        if(node_cal_attenuation.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.attenuation.att_id\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_cal_attenuation\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    if (mci_queue_tail - mci_queue_head >= MCI_QUEUE_SIZE)
+        return false;
+    MciRequest *req = &mci_queue[mci_queue_tail % MCI_QUEUE_SIZE];
+    req->kind = kind;
+    req->param = param;
+    req->job = NULL;
+    req->discard = NULL;
+    if (val != NULL) req->value = *val;
+    mci_queue_tail++;
+    pthread_cond_signal(&mci_cond);
+    return true;
 }
 
-UA_StatusCode mci_get_cal_ka(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// queue a refresh of the parameter unless one is already pending, mci_lock has to be held
+static void mci_request_refresh(int param)
 {
-    double val;
-    if(node_cal_ka.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.ka\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    MciParam *p = &mci_params[param];
+    if (!p->read_pending)
+        if (mci_enqueue(MCI_REQ_READ, param, NULL))
+            p->read_pending = true;
 }
 
-UA_StatusCode mci_set_cal_ka(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// queue refreshes for all parameters accessed by clients which are about to expire
+// returns the time [ms monotonic] when the next refresh will be due, mci_lock has to be held
+static uint64_t mci_refresh_expiring(uint64_t now)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
-    {
-        double val = *(double*)data->value.data;
-        if(node_cal_ka.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
+    uint64_t next = now + MCI_IDLE_MS;
+    for (int i=0; i<(int)mci_params.size(); i++)
+    {
+        MciParam *p = &mci_params[i];
+        unsigned int ttl = p->info->ttl_ms;
+        if (!p->accessed || !p->valid || p->read_pending)
+            continue;
+        // refresh when 3/4 of the TTL have passed, so the value never expires while in use
+        uint64_t due = p->updated + ttl - ttl/4;
+        if (due <= now)
         {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.ka\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+            // only parameters read again by a client will be refreshed again
+            p->accessed = false;
+            mci_request_refresh(i);
         }
+        else if (due < next)
+            next = due;
     }
-    else
-    {
-		printf("data error : mci_set_cal_ka\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
-}
-
-UA_StatusCode mci_get_cal_kb(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
-{
-    double val;
-    if(node_cal_kb.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.kb\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    return next;
 }
 
-UA_StatusCode mci_set_cal_kb(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// check the connection by reading the first registered parameter
+// called by the worker without holding the lock
+static bool mci_probe()
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
-    {
-        double val = *(double*)data->value.data;
-        if(node_cal_kb.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
+    MciValue val;
+    return mci_params[0].ops->fetch(mci_params[0].node, val);
+}
+
+// connect to the LiberaBase application running on local host and resolve the nodes
+// of all parameters, called by the worker (or before it is started) without holding the lock
+// returns true on success
+static bool mci_connect()
+{
+    mci::Node root;
+    try {
+        root = mci::Connect();
+    } catch (...) {
+        return false;
+    }
+    if (!root.IsValid())
+        return false;
+    node_root = root;
+    // only the worker adds parameters, so the number cannot change meanwhile
+    for (int i=0; i<(int)mci_params.size(); i++)
+    {
+        MciParam *p = &mci_params[i];
+        try {
+            p->node = node_root.GetNode(mci::Tokenize(p->info->path));
+        } catch (...) {
+            p->node = mci::Node();
+        }
+        p->ops = mci_ops(p->info->type);
+        if (!p->node.IsValid())
         {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.kb\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+            mci_error = 2;
+            printf("MCI node error : %s\n", p->info->path);
+            continue;
+        }
+        int device_type = mci_node_type(p->node);
+        if ((device_type >= 0) && (device_type != p->info->type))
+        {
+            const MciTypeOps *ops = mci_ops(p->info->type, device_type);
+            if (ops != NULL)
+                p->ops = ops;
+            else
+            {
+                mci_error = 2;
+                printf("MCI type error : %s\n", p->info->path);
+            }
         }
     }
-    else
-    {
-		printf("data error : mci_set_cal_kb\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    return true;
 }
 
-UA_StatusCode mci_get_cal_kc(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// the connection has been found broken, mci_lock has to be held
+static void mci_disconnected()
 {
-    double val;
-    if(node_cal_kc.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.kc\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    mci_connected = false;
+    mci_error = 1;
+    mci_backoff = MCI_RECONNECT_MIN_MS;
+    mci_reconnect_due = mci_now_ms() + mci_backoff;
+    printf("MCI error : connection lost\n");
 }
 
-UA_StatusCode mci_set_cal_kc(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// try to reconnect, mci_lock has to be held, it is released during the attempt
+static void mci_reconnect()
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
-    {
-        double val = *(double*)data->value.data;
-        if(node_cal_kc.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.kc\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
+    pthread_mutex_unlock(&mci_lock);
+    bool ok = mci_connect() && mci_probe();
+    pthread_mutex_lock(&mci_lock);
+    uint64_t now = mci_now_ms();
+    if (ok)
+    {
+        mci_connected = true;
+        mci_reconnects++;
+        if (mci_error == 1)
+            mci_error = 0;
+        mci_last_ok = now;
+        // all cached values are outdated, they are refreshed on the next read
+        for (int i=0; i<(int)mci_params.size(); i++)
+            mci_params[i].updated = 0;
+        printf("MCI reconnect OK\n");
     }
     else
     {
-		printf("data error : mci_set_cal_kc\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        mci_backoff *= 2;
+        if (mci_backoff > MCI_RECONNECT_MAX_MS)
+            mci_backoff = MCI_RECONNECT_MAX_MS;
+        mci_reconnect_due = now + mci_backoff;
+        printf("MCI error : can't reconnect, next attempt in %u ms\n", mci_backoff);
     }
 }
 
-UA_StatusCode mci_get_cal_kd(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// wait for a signal or the given time [ms monotonic], mci_lock has to be held
+static void mci_wait_until(uint64_t time)
+{
+    struct timespec deadline;
+    deadline.tv_sec = time / 1000;
+    deadline.tv_nsec = (long)(time % 1000) * 1000000L;
+    pthread_cond_timedwait(&mci_cond, &mci_lock, &deadline);
+}
+
+// store the result of a refresh in the cache, mci_lock has to be held
+static void mci_refreshed(int param, bool ok, const MciValue &val)
 {
-    double val;
-    if(node_cal_kd.GetValue(val))
+    MciParam *p = &mci_params[param];
+    p->read_pending = false;
+    if (ok)
     {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
+        // a queued write takes precedence over the value read
+        if (p->write_pending == 0)
+            p->value = val;
+        p->updated = mci_now_ms();
+        p->valid = true;
+        p->failed = false;
     }
     else
     {
         mci_error = 3;
-        printf("MCI value error : application.calibration.kd\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        p->failed = true;
+        printf("MCI value error : %s\n", p->info->path);
     }
 }
 
-UA_StatusCode mci_set_cal_kd(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// process the reads at the head of the queue as one batch, mci_lock has to be held
+static void mci_read_batch()
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
-    {
-        double val = *(double*)data->value.data;
-        if(node_cal_kd.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
+    // only the worker itself adds parameters, so the number cannot change during the batch
+    int num = (int)mci_params.size();
+    std::vector<int> batch(num);
+    std::vector<bool> in_batch(num, false);
+    std::vector<MciValue> val(num);
+    std::vector<bool> ok(num);
+    int n = 0;
+    // collect the reads queued by the server within the batch window,
+    // all reads of one multi-node read request arrive within a few microseconds
+    uint64_t end = mci_now_ms() + MCI_BATCH_MS;
+    struct timespec deadline;
+    deadline.tv_sec = end / 1000;
+    deadline.tv_nsec = (long)(end % 1000) * 1000000L;
+    while (mci_worker_running && (mci_now_ms() < end))
+        if (pthread_cond_timedwait(&mci_cond, &mci_lock, &deadline) == ETIMEDOUT)
+            break;
+    // take the reads up to the next write or job, so these are still done in order
+    while ((mci_queue_head != mci_queue_tail) && (mci_queue[mci_queue_head % MCI_QUEUE_SIZE].kind == MCI_REQ_READ))
+    {
+        int param = mci_queue[mci_queue_head % MCI_QUEUE_SIZE].param;
+        mci_queue_head++;
+        if (!in_batch[param])
         {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.kd\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+            in_batch[param] = true;
+            batch[n++] = param;
         }
     }
-    else
-    {
-		printf("data error : mci_set_cal_kd\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    // a client reading one parameter of a folder will most likely read the others, too.
+    // so the siblings which have passed half of their TTL are refreshed with the batch
+    uint64_t now = mci_now_ms();
+    int requested = n;
+    for (int k=0; k<requested; k++)
+        for (int i=0; i<num; i++)
+        {
+            MciParam *p = &mci_params[i];
+            if (in_batch[i] || p->read_pending || (p->write_pending > 0))
+                continue;
+            if (p->info->parent != mci_params[batch[k]].info->parent)
+                continue;
+            if (p->valid && (now - p->updated < p->info->ttl_ms / 2))
+                continue;
+            in_batch[i] = true;
+            p->read_pending = true;
+            batch[n++] = i;
+        }
+    // the MCI calls are made without holding the lock
+    pthread_mutex_unlock(&mci_lock);
+    for (int k=0; k<n; k++)
+    {
+        MciParam *p = &mci_params[batch[k]];
+        MciValue v;
+        ok[k] = p->ops->fetch(p->node, v);
+        val[k] = v;
+    }
+    int good = 0;
+    for (int k=0; k<n; k++)
+        if (ok[k]) good++;
+    // if all reads have failed, check whether the device is still there
+    bool lost = (n > 0) && (good == 0) && !mci_probe();
+    pthread_mutex_lock(&mci_lock);
+    for (int k=0; k<n; k++)
+        mci_refreshed(batch[k], ok[k], val[k]);
+    mci_batches++;
+    mci_batch_reads += n;
+    if (good > 0)
+        mci_last_ok = mci_now_ms();
+    if (lost)
+        mci_disconnected();
 }
 
-UA_StatusCode mci_get_cal_linx(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// the worker thread processing the MCI requests
+// the queue is drained before the thread exits, unless the connection is broken
+static void *mci_worker(void *arg)
 {
-    double val;
-    if(node_cal_linx.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
+    pthread_mutex_lock(&mci_lock);
+    while (mci_worker_running || (mci_connected && (mci_queue_head != mci_queue_tail)))
     {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.linear.x.k\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        if (!mci_connected)
+        {
+            // requests remain queued until the connection is back
+            if (mci_now_ms() >= mci_reconnect_due)
+                mci_reconnect();
+            else
+                mci_wait_until(mci_reconnect_due);
+            continue;
+        }
+        if (mci_queue_head == mci_queue_tail)
+        {
+            uint64_t now = mci_now_ms();
+            // health check if there was no MCI traffic for a while
+            if (now - mci_last_ok >= MCI_HEALTH_MS)
+            {
+                pthread_mutex_unlock(&mci_lock);
+                bool ok = mci_probe();
+                pthread_mutex_lock(&mci_lock);
+                if (ok)
+                    mci_last_ok = mci_now_ms();
+                else
+                    mci_disconnected();
+                continue;
+            }
+            // background refresh of the cache
+            uint64_t next = mci_refresh_expiring(now);
+            if (next > mci_last_ok + MCI_HEALTH_MS)
+                next = mci_last_ok + MCI_HEALTH_MS;
+            if ((mci_queue_head == mci_queue_tail) && mci_worker_running)
+                mci_wait_until(next);
+            continue;
+        }
+        MciRequest req = mci_queue[mci_queue_head % MCI_QUEUE_SIZE];
+        if (req.kind == MCI_REQ_READ)
+        {
+            mci_read_batch();
+            continue;
+        }
+        mci_queue_head++;
+        if (req.kind == MCI_REQ_JOB)
+        {
+            pthread_mutex_unlock(&mci_lock);
+            req.job(req.arg);
+            pthread_mutex_lock(&mci_lock);
+            continue;
+        }
+        MciParam *p = &mci_params[req.param];
+        const MciParamInfo *info = p->info;
+        // the MCI call is made without holding the lock
+        pthread_mutex_unlock(&mci_lock);
+        MciValue val = req.value;
+        bool ok = p->ops->store(p->node, val);
+        pthread_mutex_lock(&mci_lock);
+        p->write_pending--;
+        if (ok)
+        {
+            p->updated = mci_now_ms();
+            mci_last_ok = p->updated;
+        }
+        else
+        {
+            mci_error = 4;
+            printf("MCI value error : %s\n", info->path);
+            // restore the cache from the device
+            mci_request_refresh(req.param);
+        }
     }
+    pthread_mutex_unlock(&mci_lock);
+    return NULL;
 }
 
-UA_StatusCode mci_set_cal_linx(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+int mci_init()
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
+    mci::Init();
+    mci_error = 0;
+    for (int i=0; i<MCI_NUM_PARAMS; i++)
     {
-        double val = *(double*)data->value.data;
-        if(node_cal_linx.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
+        mci_params.push_back(MciParam());
+        mci_params[i].info = &mci_registry[i];
+        mci_params[i].ops = mci_ops(mci_registry[i].type);
+        if (mci_ops(mci_registry[i].type) == NULL)
         {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.linear.x.k\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
+            mci_error = 2;
+            printf("MCI type error : %s\n", mci_registry[i].path);
+        };
     }
-    else
+    // connect to LiberaBase application running on local host and resolve the nodes
+    // if that fails, the worker keeps trying to connect
+    mci_connected = mci_connect();
+    if (mci_connected)
     {
-		printf("data error : mci_set_cal_linx\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+        printf("MCI connect OK\n");
+    } else {
+        printf("MCI error : can't connect, retrying\n");
+        mci_error = 1;
+        mci_reconnect_due = mci_now_ms() + mci_backoff;
+    }
+    // read the initial values
+    // the worker is not yet running, so this can be done without locking
+    for (int i=0; mci_connected && (i<MCI_NUM_PARAMS); i++)
+    {
+        MciParam *p = &mci_params[i];
+        if (!p->node.IsValid() || (p->ops == NULL))
+            continue;
+        p->valid = p->ops->fetch(p->node, p->value);
+        p->updated = mci_now_ms();
+        if (!p->valid)
+            printf("MCI value error : %s\n", p->info->path);
+    }
+    mci_last_ok = mci_now_ms();
+    // the worker waits on the monotonic clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mci_cond, &attr);
+    pthread_cond_init(&mci_done_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    // start the worker thread
+    mci_worker_running = true;
+    if (0 != pthread_create(&mci_worker_tid, NULL, &mci_worker, NULL))
+    {
+        mci_worker_running = false;
+        printf("MCI error : failed to create worker thread\n");
+        mci_error = 5;
+    }
+    // a missing connection is not fatal, the worker reconnects
+    return((mci_error == 1) ? 0 : mci_error);
 }
 
-UA_StatusCode mci_get_cal_liny(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+int mci_shutdown()
+{
+    // stop the worker thread after all queued writes are done
+    pthread_mutex_lock(&mci_lock);
+    bool running = mci_worker_running;
+    mci_worker_running = false;
+    pthread_cond_signal(&mci_cond);
+    pthread_mutex_unlock(&mci_lock);
+    if (running)
+        pthread_join(mci_worker_tid, NULL);
+    // without a connection the worker leaves the requests queued, drop them
+    pthread_mutex_lock(&mci_lock);
+    if (mci_queue_head != mci_queue_tail)
+        printf("MCI : %u requests dropped at shutdown\n", mci_queue_tail - mci_queue_head);
+    while (mci_queue_head != mci_queue_tail)
+    {
+        MciRequest *req = &mci_queue[mci_queue_head % MCI_QUEUE_SIZE];
+        mci_queue_head++;
+        if (req->kind == MCI_REQ_WRITE)
+            mci_params[req->param].write_pending--;
+        if ((req->kind == MCI_REQ_JOB) && (req->discard != NULL))
+            req->discard(req->arg);
+    }
+    pthread_mutex_unlock(&mci_lock);
+    // release the parameters added at run time
+    for (int i=MCI_NUM_PARAMS; i<(int)mci_params.size(); i++)
+    {
+        MciDynParam *dyn = (MciDynParam *)mci_params[i].info;
+        free((void *)dyn->info.path);
+        free((void *)dyn->info.name);
+        delete dyn;
+    }
+    mci_params.clear();
+    mci::Shutdown();
+    printf("MCI read batches : %llu with %llu reads\n",
+        (unsigned long long)mci_batches, (unsigned long long)mci_batch_reads);
+    printf("MCI shutdown OK\n");
+    return(0);
+}
+
+int mci_num_params()
+{
+    return MCI_NUM_PARAMS;
+}
+
+const MciParamInfo *mci_param_info(int index)
 {
-    double val;
-    if(node_cal_liny.GetValue(val))
+    if ((index < 0) || (index >= MCI_NUM_PARAMS))
+        return NULL;
+    return &mci_registry[index];
+}
+
+bool mci_submit(void (*job)(void *arg), void *arg)
+{
+    pthread_mutex_lock(&mci_lock);
+    bool queued = mci_worker_running && mci_enqueue(MCI_REQ_JOB, -1, NULL);
+    if (queued)
     {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
+        MciRequest *req = &mci_queue[(mci_queue_tail-1) % MCI_QUEUE_SIZE];
+        req->job = job;
+        req->arg = arg;
     }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.linear.y.k\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+    pthread_mutex_unlock(&mci_lock);
+    return queued;
+}
+
+mci::Node mci_root()
+{
+    return node_root;
+}
+
+int mci_node_type(const mci::Node &node)
+{
+    mci::NodeValType_e type;
+    try {
+        type = node.GetValueType();
+    } catch (...) {
+        return MCI_UNSUPPORTED;
+    }
+    switch (type)
+    {
+        case mci::eNvUndefined : return MCI_NO_VALUE;
+        case mci::eNvBool : return UA_TYPES_BOOLEAN;
+        case mci::eNvLong : return UA_TYPES_INT32;
+        case mci::eNvULong : return UA_TYPES_UINT32;
+        case mci::eNvLongLong : return UA_TYPES_INT64;
+        case mci::eNvULongLong : return UA_TYPES_UINT64;
+        case mci::eNvDouble : return UA_TYPES_DOUBLE;
+        default : return MCI_UNSUPPORTED;
     }
 }
 
-UA_StatusCode mci_set_cal_liny(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+const MciParamInfo *mci_add_param(
+    const mci::Node &node, const char *path, UA_UInt32 parent,
+    const char *name, int type, UA_Byte access, unsigned int ttl_ms)
+{
+    if (mci_ops(type) == NULL)
+        return NULL;
+    MciDynParam *dyn = new MciDynParam;
+    dyn->info.path = strdup(path);
+    dyn->info.id = 0;
+    dyn->info.parent = parent;
+    dyn->info.name = strdup(name);
+    dyn->info.description = dyn->info.path;
+    dyn->info.type = type;
+    dyn->info.access = access;
+    dyn->info.ttl_ms = ttl_ms;
+    // we are on the worker thread, so the initial value can be read right away
+    MciParam param = MciParam();
+    param.info = &dyn->info;
+    param.node = node;
+    param.ops = mci_ops(type);
+    param.valid = param.ops->fetch(param.node, param.value);
+    param.updated = mci_now_ms();
+    pthread_mutex_lock(&mci_lock);
+    dyn->index = (int)mci_params.size();
+    mci_params.push_back(param);
+    pthread_mutex_unlock(&mci_lock);
+    return &dyn->info;
+}
+
+// a set of parameters written or read by one job
+struct MciParamSet {
+    bool write;
+    std::vector<int> params;
+    std::vector<MciValue> values;
+    std::vector<UA_StatusCode> status;
+    bool done;
+    bool abandoned;     // the caller has given up waiting, the job has to free the set
+    bool aborted;       // the write has failed and the previous values have been restored
+};
+
+// write the values of a set, called by the set job
+// The previous values are read first. When a value cannot be written, the rest
+// of the set is not written and the values already written are restored, so the
+// device is not left with a partially applied set. The parameters which hold
+// their previous value again are marked BadOperationAbandoned, those which could
+// not be written or restored BadCommunicationError.
+static void mci_write_values(MciParamSet *set)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
+    size_t n = set->params.size();
+    std::vector<MciValue> before(n);
+    size_t failed = n;
+    for (size_t k=0; k<n; k++)
     {
-        double val = *(double*)data->value.data;
-        if(node_cal_liny.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
+        MciParam *p = &mci_params[set->params[k]];
+        if (!p->ops->fetch(p->node, before[k]))
         {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.linear.y.k\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+            // nothing has been written yet
+            set->status.assign(n, UA_STATUSCODE_BADOPERATIONABANDONED);
+            set->status[k] = UA_STATUSCODE_BADCOMMUNICATIONERROR;
+            set->aborted = true;
+            return;
         }
     }
-    else
-    {
-		printf("data error : mci_set_cal_liny\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
-}
-
-UA_StatusCode mci_get_cal_linq(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
-{
-    double val;
-    if(node_cal_linq.GetValue(val))
+    for (size_t k=0; (k<n) && (failed==n); k++)
     {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
+        MciParam *p = &mci_params[set->params[k]];
+        MciValue val = set->values[k];
+        if (!p->ops->store(p->node, val))
+            failed = k;
     }
-    else
+    if (failed == n)
+        return;
+    set->aborted = true;
+    set->status.assign(n, UA_STATUSCODE_BADOPERATIONABANDONED);
+    // the failed write may have taken effect partially, so it is restored as well
+    for (size_t k=failed+1; k-- > 0; )
     {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.linear.q.k\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        MciParam *p = &mci_params[set->params[k]];
+        if (!p->ops->store(p->node, before[k]) || (k == failed))
+            set->status[k] = UA_STATUSCODE_BADCOMMUNICATIONERROR;
     }
+    printf("MCI value error : %s, set of %u parameters restored\n",
+        mci_params[set->params[failed]].info->path, (unsigned int)n);
 }
 
-UA_StatusCode mci_set_cal_linq(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// process all parameters of the set, runs on the worker thread
+// a written set is read back for verification
+static void mci_set_job(void *arg)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
-    {
-        double val = *(double*)data->value.data;
-        if(node_cal_linq.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
+    MciParamSet *set = (MciParamSet *)arg;
+    size_t n = set->params.size();
+    std::vector<MciValue> readback(n);
+    std::vector<bool> fetched(n, false);
+    // all writes first, so the device runs with a partially written set for the shortest time
+    if (set->write)
+        mci_write_values(set);
+    for (size_t k=0; k<n; k++)
+    {
+        MciParam *p = &mci_params[set->params[k]];
+        const MciTypeOps *ops = p->ops;
+        fetched[k] = ops->fetch(p->node, readback[k]);
+        if (set->status[k] != UA_STATUSCODE_GOOD)
+            continue;
+        if (!fetched[k])
+            set->status[k] = UA_STATUSCODE_BADCOMMUNICATIONERROR;
+        else if (!set->write)
+            set->values[k] = readback[k];
+        else if (!ops->equal(readback[k], set->values[k]))
+            // the device has not accepted the value as it was
+            set->status[k] = UA_STATUSCODE_BADOUTOFRANGE;
+    }
+    pthread_mutex_lock(&mci_lock);
+    uint64_t now = mci_now_ms();
+    for (size_t k=0; k<n; k++)
+        if (fetched[k])
         {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.linear.q.k\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+            MciParam *p = &mci_params[set->params[k]];
+            if (p->write_pending == 0)
+                p->value = readback[k];
+            p->updated = now;
+            p->valid = true;
+            p->failed = false;
+            mci_last_ok = now;
         }
-    }
+    set->done = true;
+    if (set->abandoned)
+        delete set;
     else
-    {
-		printf("data error : mci_set_cal_linq\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+        pthread_cond_broadcast(&mci_done_cond);
+    pthread_mutex_unlock(&mci_lock);
 }
 
-UA_StatusCode mci_get_cal_lins(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// a set job dropped from the queue, mci_lock is held
+// an abandoned set is freed, a caller still waiting gets the failure
+static void mci_set_discard(void *arg)
 {
-    double val;
-    if(node_cal_lins.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
+    MciParamSet *set = (MciParamSet *)arg;
+    if (set->abandoned)
     {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.linear.sum.k\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        delete set;
+        return;
     }
+    set->status.assign(set->params.size(), UA_STATUSCODE_BADNOCOMMUNICATION);
+    set->done = true;
+    pthread_cond_broadcast(&mci_done_cond);
 }
 
-UA_StatusCode mci_set_cal_lins(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+// queue the set for the worker and wait until it is done
+// the set is deleted in any case, on success status[] and (for reads) values[] are filled in
+static UA_StatusCode mci_run_set(MciParamSet *set, UA_StatusCode *status, UA_Variant *values, unsigned int timeout_ms)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
-    {
-        double val = *(double*)data->value.data;
-        if(node_cal_lins.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
+    size_t n = set->params.size();
+    UA_StatusCode res = UA_STATUSCODE_GOOD;
+    pthread_mutex_lock(&mci_lock);
+    if (!mci_connected)
+        res = UA_STATUSCODE_BADNOCOMMUNICATION;
+    else if (!mci_worker_running || !mci_enqueue(MCI_REQ_JOB, -1, NULL))
+        res = UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    if (res != UA_STATUSCODE_GOOD)
+    {
+        pthread_mutex_unlock(&mci_lock);
+        delete set;
+        return res;
+    }
+    MciRequest *req = &mci_queue[(mci_queue_tail-1) % MCI_QUEUE_SIZE];
+    req->job = mci_set_job;
+    req->discard = mci_set_discard;
+    req->arg = set;
+    // wait for the worker
+    uint64_t end = mci_now_ms() + timeout_ms;
+    struct timespec deadline;
+    deadline.tv_sec = end / 1000;
+    deadline.tv_nsec = (long)(end % 1000) * 1000000L;
+    while (!set->done)
+        if (pthread_cond_timedwait(&mci_done_cond, &mci_lock, &deadline) == ETIMEDOUT)
+            break;
+    if (set->done)
+    {
+        if (set->aborted)
+            res = UA_STATUSCODE_BADCOMMUNICATIONERROR;
+        for (size_t k=0; k<n; k++)
         {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.linear.sum.k\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+            status[k] = set->status[k];
+            if (!set->write && (status[k] == UA_STATUSCODE_GOOD))
+                mci_ops(mci_params[set->params[k]].info->type)->to_variant(set->values[k], &values[k]);
         }
+        delete set;
     }
     else
     {
-		printf("data error : mci_set_cal_lins\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        // the job will free the set when it is done
+        set->abandoned = true;
+        res = UA_STATUSCODE_BADTIMEOUT;
+        for (size_t k=0; k<n; k++)
+            status[k] = UA_STATUSCODE_BADTIMEOUT;
     }
+    pthread_mutex_unlock(&mci_lock);
+    return res;
 }
 
-UA_StatusCode mci_get_cal_offx(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue)
+// a new set for n parameters
+static MciParamSet *mci_new_set(bool write, size_t n, const MciParamInfo *const *params)
 {
-    double val;
-    if(node_cal_offx.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.linear.x.offs\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    MciParamSet *set = new MciParamSet;
+    set->write = write;
+    set->params.resize(n);
+    set->values.resize(n);
+    set->status.assign(n, UA_STATUSCODE_GOOD);
+    set->done = false;
+    set->abandoned = false;
+    set->aborted = false;
+    for (size_t k=0; k<n; k++)
+        set->params[k] = mci_index(params[k]);
+    return set;
 }
 
-UA_StatusCode mci_set_cal_offx(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data)
+UA_StatusCode mci_write_set(
+    size_t n, const MciParamInfo *const *params, const UA_Variant *values,
+    UA_StatusCode *status, unsigned int timeout_ms)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
+    MciParamSet *set = mci_new_set(true, n, params);
+    UA_StatusCode res = UA_STATUSCODE_GOOD;
+    for (size_t k=0; k<n; k++)
     {
-        double val = *(double*)data->value.data;
-        if(node_cal_offx.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.linear.x.offs\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
+        status[k] = UA_STATUSCODE_GOOD;
+        if (!(params[k]->access & UA_ACCESSLEVELMASK_WRITE))
+            status[k] = UA_STATUSCODE_BADNOTWRITABLE;
+        else if (!mci_ops(params[k]->type)->from_variant(&values[k], set->values[k]))
+            status[k] = UA_STATUSCODE_BADTYPEMISMATCH;
+        if (status[k] != UA_STATUSCODE_GOOD)
+            res = status[k];
     }
-    else
+    // nothing is written unless all values are valid
+    if (res != UA_STATUSCODE_GOOD)
     {
-		printf("data error : mci_set_cal_offx\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        delete set;
+        return res;
     }
+    return mci_run_set(set, status, NULL, timeout_ms);
 }
 
-UA_StatusCode mci_get_cal_offy(
+UA_StatusCode mci_read_set(
+    size_t n, const MciParamInfo *const *params, UA_Variant *values,
+    UA_StatusCode *status, unsigned int timeout_ms)
+{
+    return mci_run_set(mci_new_set(false, n, params), status, values, timeout_ms);
+}
+
+// answer a read from the cache, queue a refresh if the value has expired
+UA_StatusCode mci_read(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
@@ -1049,48 +1116,78 @@ UA_StatusCode mci_get_cal_offy(
     const UA_NumericRange *range,
     UA_DataValue *dataValue)
 {
-    double val;
-    if(node_cal_offy.GetValue(val))
+    const MciParamInfo *info = (const MciParamInfo *)nodeContext;
+    int param = mci_index(info);
+    pthread_mutex_lock(&mci_lock);
+    MciParam *p = &mci_params[param];
+    MciValue val = p->value;
+    bool valid = p->valid;
+    bool failed = p->failed || !mci_connected;
+    bool connected = mci_connected;
+    if (valid && (mci_now_ms() - p->updated < info->ttl_ms))
+        mci_cache_hits++;
+    else
     {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
+        mci_cache_misses++;
+        mci_request_refresh(param);
     }
-    else
+    p->accessed = true;
+    pthread_mutex_unlock(&mci_lock);
+    if (!valid)
+        return connected ? UA_STATUSCODE_BADWAITINGFORINITIALDATA : UA_STATUSCODE_BADNOCOMMUNICATION;
+    mci_ops(info->type)->to_variant(val, &dataValue->value);
+    dataValue->hasValue = true;
+    if (failed)
     {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.linear.y.offs\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        dataValue->hasStatus = true;
+        dataValue->status = UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
     }
+    return UA_STATUSCODE_GOOD;
 }
 
-UA_StatusCode mci_set_cal_offy(
+// update the cache and queue the write to the device
+UA_StatusCode mci_write(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
     const UA_NumericRange *range,
     const UA_DataValue *data)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
+    const MciParamInfo *info = (const MciParamInfo *)nodeContext;
+    int param = mci_index(info);
+    MciValue val;
+    if (!(info->access & UA_ACCESSLEVELMASK_WRITE))
+        return UA_STATUSCODE_BADNOTWRITABLE;
+    if (!data->hasValue || !mci_ops(info->type)->from_variant(&data->value, val))
     {
-        double val = *(double*)data->value.data;
-        if(node_cal_offy.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.linear.y.offs\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
+        printf("data error : %s\n", info->path);
+        return UA_STATUSCODE_BADTYPEMISMATCH;
     }
-    else
+    pthread_mutex_lock(&mci_lock);
+    if (!mci_connected)
+    {
+        pthread_mutex_unlock(&mci_lock);
+        return UA_STATUSCODE_BADNOCOMMUNICATION;
+    }
+    bool queued = mci_enqueue(MCI_REQ_WRITE, param, &val);
+    if (queued)
+    {
+        MciParam *p = &mci_params[param];
+        p->value = val;
+        p->updated = mci_now_ms();
+        p->valid = true;
+        p->write_pending++;
+    }
+    pthread_mutex_unlock(&mci_lock);
+    if (!queued)
     {
-		printf("data error : mci_set_cal_offy\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
+        printf("MCI queue full : %s\n", info->path);
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
     }
+    return UA_STATUSCODE_GOOD;
 }
 
-UA_StatusCode mci_get_cal_offq(
+UA_StatusCode mci_get_cache_hits(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
@@ -1098,48 +1195,31 @@ UA_StatusCode mci_get_cal_offq(
     const UA_NumericRange *range,
     UA_DataValue *dataValue)
 {
-    double val;
-    if(node_cal_offq.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.linear.q.offs\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    pthread_mutex_lock(&mci_lock);
+    UA_UInt64 val = mci_cache_hits;
+    pthread_mutex_unlock(&mci_lock);
+    UA_Variant_setScalarCopy(&dataValue->value, &val, &UA_TYPES[UA_TYPES_UINT64]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
 }
 
-UA_StatusCode mci_set_cal_offq(
+UA_StatusCode mci_get_cache_misses(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean sourceTimeStamp,
     const UA_NumericRange *range,
-    const UA_DataValue *data)
+    UA_DataValue *dataValue)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
-    {
-        double val = *(double*)data->value.data;
-        if(node_cal_offq.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.linear.q.offs\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_cal_offq\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    pthread_mutex_lock(&mci_lock);
+    UA_UInt64 val = mci_cache_misses;
+    pthread_mutex_unlock(&mci_lock);
+    UA_Variant_setScalarCopy(&dataValue->value, &val, &UA_TYPES[UA_TYPES_UINT64]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
 }
 
-UA_StatusCode mci_get_cal_offs(
+UA_StatusCode mci_get_connected(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
@@ -1147,44 +1227,26 @@ UA_StatusCode mci_get_cal_offs(
     const UA_NumericRange *range,
     UA_DataValue *dataValue)
 {
-    double val;
-    if(node_cal_offs.GetValue(val))
-    {
-        UA_Variant_setScalarCopy(&dataValue->value, (UA_Double*)(&val), &UA_TYPES[UA_TYPES_DOUBLE]);
-        dataValue->hasValue = true;
-        return UA_STATUSCODE_GOOD;
-    }
-    else
-    {
-        mci_error = 3;
-        printf("MCI value error : application.calibration.linear.sum.offs\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    pthread_mutex_lock(&mci_lock);
+    UA_Boolean val = mci_connected;
+    pthread_mutex_unlock(&mci_lock);
+    UA_Variant_setScalarCopy(&dataValue->value, &val, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
 }
 
-UA_StatusCode mci_set_cal_offs(
+UA_StatusCode mci_get_reconnects(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
+    UA_Boolean sourceTimeStamp,
     const UA_NumericRange *range,
-    const UA_DataValue *data)
+    UA_DataValue *dataValue)
 {
-    if(data->hasValue && UA_Variant_isScalar(&data->value) && (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) && (data->value.data != 0))
-    {
-        double val = *(double*)data->value.data;
-        if(node_cal_offs.SetValue(val))
-            return UA_STATUSCODE_GOOD;
-        else
-        {
-            mci_error = 4;
-            printf("MCI value error : application.calibration.linear.sum.offs\n");
-            return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-        }
-    }
-    else
-    {
-		printf("data error : mci_set_cal_offs\n");
-        return UA_STATUSCODE_UNCERTAINNOCOMMUNICATIONLASTUSABLEVALUE;
-    }
+    pthread_mutex_lock(&mci_lock);
+    UA_UInt32 val = mci_reconnects;
+    pthread_mutex_unlock(&mci_lock);
+    UA_Variant_setScalarCopy(&dataValue->value, &val, &UA_TYPES[UA_TYPES_UINT32]);
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
 }
-
@@ -38,296 +38,126 @@ extern "C" {
 #endif
 
 // initialize MCI connection
+// a connection failure is not fatal, the worker thread keeps trying to reconnect
 int mci_init();
 // shutdown MCI connection
 int mci_shutdown();
 
-// OPC-UA data source routines
+// the registry of the MCI parameters accessible as OPC-UA variables
+typedef struct {
+    const char *path;           // MCI path of the parameter
+    UA_UInt32 id;               // node ID in namespace 1
+    UA_UInt32 parent;           // node ID of the parent folder
+    const char *name;           // browse and display name
+    const char *description;
+    int type;                   // index into UA_TYPES
+    UA_Byte access;             // UA_ACCESSLEVELMASK_READ / _WRITE
+    unsigned int ttl_ms;        // time-to-live of the cached value
+} MciParamInfo;
 
-UA_StatusCode mci_get_dev_freq(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-
-UA_StatusCode mci_get_dsp_enable(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_dsp_enable(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
-
-UA_StatusCode mci_get_dsp_thr1(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_dsp_thr1(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+// number of parameters in the registry (not counting those added at run time)
+int mci_num_params();
+// description of a parameter, used as nodeContext of its variable node
+const MciParamInfo *mci_param_info(int index);
 
-UA_StatusCode mci_get_dsp_pre(
+// OPC-UA data source routines for all registered parameters
+// the nodeContext has to be the MciParamInfo pointer of the parameter
+UA_StatusCode mci_read(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
     UA_Boolean sourceTimeStamp,
     const UA_NumericRange *range,
     UA_DataValue *dataValue);
-UA_StatusCode mci_set_dsp_pre(
+UA_StatusCode mci_write(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
     const UA_NumericRange *range,
     const UA_DataValue *data);
 
-UA_StatusCode mci_get_dsp_post1(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_dsp_post1(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
-
-UA_StatusCode mci_get_dsp_timeout(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_dsp_timeout(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+// write a set of parameters with one job of the worker thread and read them back
+// nothing is written unless all values have the correct type and the parameters are writable
+// blocks until the worker is done or the timeout [ms] expires
+// status[i] receives the result for params[i] : Good, or Bad if writing failed or the
+// value read back differs from the value written
+// if a value cannot be written, the values already written are restored, these parameters
+// get BadOperationAbandoned and the result is BadCommunicationError
+// returns Good if the set was processed, otherwise the reason why it was not
+UA_StatusCode mci_write_set(
+    size_t n, const MciParamInfo *const *params, const UA_Variant *values,
+    UA_StatusCode *status, unsigned int timeout_ms);
 
-UA_StatusCode mci_get_dsp_averaging(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_dsp_averaging(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+// read a set of parameters from the device with one job of the worker thread
+// blocks until the worker is done or the timeout [ms] expires
+// values[i] receives the value of params[i] if status[i] is Good, the caller has to clear it
+// returns Good if the set was processed, otherwise the reason why it was not
+UA_StatusCode mci_read_set(
+    size_t n, const MciParamInfo *const *params, UA_Variant *values,
+    UA_StatusCode *status, unsigned int timeout_ms);
 
-UA_StatusCode mci_get_maxadc(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
+// run a job on the MCI worker thread, jobs may make MCI calls
+// returns false if the queue is full or the worker is not running
+bool mci_submit(void (*job)(void *arg), void *arg);
 
-UA_StatusCode mci_get_cal_attenuation(
+// statistics of the MCI parameter cache
+UA_StatusCode mci_get_cache_hits(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
     UA_Boolean sourceTimeStamp,
     const UA_NumericRange *range,
     UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_attenuation(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
-
-UA_StatusCode mci_get_cal_ka(
+UA_StatusCode mci_get_cache_misses(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
     UA_Boolean sourceTimeStamp,
     const UA_NumericRange *range,
     UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_ka(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
 
-UA_StatusCode mci_get_cal_kb(
+// state of the connection to the LiberaBase application
+UA_StatusCode mci_get_connected(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
     UA_Boolean sourceTimeStamp,
     const UA_NumericRange *range,
     UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_kb(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
-
-UA_StatusCode mci_get_cal_kc(
+UA_StatusCode mci_get_reconnects(
     UA_Server *server,
     const UA_NodeId *sessionId, void *sessionContext,
     const UA_NodeId *nodeId, void *nodeContext,
     UA_Boolean sourceTimeStamp,
     const UA_NumericRange *range,
     UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_kc(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
 
-UA_StatusCode mci_get_cal_kd(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_kd(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
-
-UA_StatusCode mci_get_cal_linx(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_linx(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
-
-UA_StatusCode mci_get_cal_liny(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_liny(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
-
-UA_StatusCode mci_get_cal_linq(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_linq(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+#ifdef __cplusplus
+} // extern "C"
 
-UA_StatusCode mci_get_cal_lins(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_lins(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+#ifdef MCI_MOCK
+#include "libera_mci_mock.h" // in-process MCI backend for host builds
+#else
+#include "mci/mci.h"
+#endif
 
-UA_StatusCode mci_get_cal_offx(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_offx(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+// the root node of the MCI tree
+mci::Node mci_root();
 
-UA_StatusCode mci_get_cal_offy(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_offy(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+// mci_node_type() results for nodes which cannot be mirrored as a variable
+#define MCI_NO_VALUE -1
+#define MCI_UNSUPPORTED -2
 
-UA_StatusCode mci_get_cal_offq(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_offq(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+// the OPC-UA type (index into UA_TYPES) of the value of a node
+int mci_node_type(const mci::Node &node);
 
-UA_StatusCode mci_get_cal_offs(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    UA_Boolean sourceTimeStamp,
-    const UA_NumericRange *range,
-    UA_DataValue *dataValue);
-UA_StatusCode mci_set_cal_offs(
-    UA_Server *server,
-    const UA_NodeId *sessionId, void *sessionContext,
-    const UA_NodeId *nodeId, void *nodeContext,
-    const UA_NumericRange *range,
-    const UA_DataValue *data);
+// add a parameter to the cache at run time, it is refreshed like the registered ones
+// has to be called from a job on the worker thread, the initial value is read immediately
+// returns the description to be used as nodeContext, NULL if the type is not supported
+const MciParamInfo *mci_add_param(
+    const mci::Node &node, const char *path, UA_UInt32 parent,
+    const char *name, int type, UA_Byte access, unsigned int ttl_ms);
 
-#ifdef __cplusplus
-} // extern "C"
 #endif
 
 #endif
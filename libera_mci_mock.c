@@ -0,0 +1,342 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_mci_mock.c
+  OpcUaStreamServer : in-process replacement of the MCI library for host builds
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdexcept>
+
+#include "libera_mci_mock.h"
+
+namespace mci {
+
+// a node of the tree, folders have the type eNvUndefined
+struct MockNode {
+    std::string name;
+    NodeValType_e type;
+    union {
+        bool b;
+        int32_t l;
+        unsigned int u;
+        int64_t i;
+        uint64_t ul;
+        double d;
+    } value;
+    std::string str;
+    // the value changes with every read (measurements), scattering around the nominal value
+    bool live;
+    double nominal;
+    std::vector<MockNode *> children;
+};
+
+// the parameters of the tree with their initial values
+struct MockParam {
+    const char *path;
+    NodeValType_e type;
+    const char *value;
+    bool live;
+};
+
+static const MockParam mock_params[] = {
+    { "application.clock_info.adc_frequency", eNvULong, "117440000", false },
+    { "application.clock_info.mc_frequency", eNvDouble, "1300000000.0", false },
+    { "application.input.max_adc", eNvULong, "12000", true },
+    { "application.dsp.enable", eNvBool, "true", false },
+    { "application.dsp.bunch_thr1", eNvULong, "1000", false },
+    { "application.dsp.pre_trigger", eNvULong, "10", false },
+    { "application.dsp.post_trigger1", eNvULong, "50", false },
+    { "application.dsp.scan_timeout", eNvULong, "1000", false },
+    { "application.dsp.data_averaging", eNvULong, "1", false },
+    { "application.attenuation.att_id", eNvLongLong, "10", false },
+    { "application.calibration.ka", eNvDouble, "1.0", false },
+    { "application.calibration.kb", eNvDouble, "1.0", false },
+    { "application.calibration.kc", eNvDouble, "1.0", false },
+    { "application.calibration.kd", eNvDouble, "1.0", false },
+    { "application.calibration.linear.x.k", eNvDouble, "10000000.0", false },
+    { "application.calibration.linear.y.k", eNvDouble, "10000000.0", false },
+    { "application.calibration.linear.q.k", eNvDouble, "10000000.0", false },
+    { "application.calibration.linear.sum.k", eNvDouble, "1.0", false },
+    { "application.calibration.linear.x.offs", eNvDouble, "0.0", false },
+    { "application.calibration.linear.y.offs", eNvDouble, "0.0", false },
+    { "application.calibration.linear.q.offs", eNvDouble, "0.0", false },
+    { "application.calibration.linear.sum.offs", eNvDouble, "0.0", false },
+    { "application.info.name", eNvString, "mock", false },
+    { "boards.raf3.sensors.temp", eNvLong, "45", true },
+    { "boards.raf3.sensors.fan_speed", eNvULongLong, "4200", true }
+};
+#define MOCK_NUM_PARAMS ((int)(sizeof(mock_params)/sizeof(mock_params[0])))
+
+static MockNode *mock_root = NULL;
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// behaviour of the connection
+static double mock_latency_min = 0.0;   // [ms]
+static double mock_latency_max = 0.0;   // [ms]
+static double mock_fail = 0.0;          // probability
+static double mock_outage_period = 0.0; // [s]
+static double mock_outage_duration = 0.0;
+static struct timespec mock_start;
+static unsigned int mock_seed = 1;
+
+static double mock_random()
+{
+    return (double)rand_r(&mock_seed) / RAND_MAX;
+}
+
+static bool mock_outage()
+{
+    if (mock_outage_period <= 0.0)
+        return false;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double t = (now.tv_sec - mock_start.tv_sec) + 1.e-9 * (now.tv_nsec - mock_start.tv_nsec);
+    double phase = t - mock_outage_period * (long)(t / mock_outage_period);
+    return phase >= mock_outage_period - mock_outage_duration;
+}
+
+// every call to LiberaBase takes time and may fail, mock_lock has to be held
+static void mock_call()
+{
+    double ms = mock_latency_min + (mock_latency_max - mock_latency_min) * mock_random();
+    if (ms > 0.0)
+    {
+        struct timespec delay = { (time_t)(ms / 1000.0), (long)((ms - 1000.0 * (long)(ms / 1000.0)) * 1.e6) };
+        nanosleep(&delay, NULL);
+    }
+    if (mock_outage() || ((mock_fail > 0.0) && (mock_random() < mock_fail)))
+    {
+        pthread_mutex_unlock(&mock_lock);
+        throw std::runtime_error("MCI mock : connection lost");
+    }
+}
+
+// the node of a path, folders are created when missing
+static MockNode *mock_create(const Path &path)
+{
+    MockNode *node = mock_root;
+    for (size_t i=0; i<path.size(); i++)
+    {
+        MockNode *child = NULL;
+        for (size_t k=0; k<node->children.size(); k++)
+            if (node->children[k]->name == path[i])
+                child = node->children[k];
+        if (child == NULL)
+        {
+            child = new MockNode();
+            child->name = path[i];
+            child->type = eNvUndefined;
+            child->live = false;
+            node->children.push_back(child);
+        }
+        node = child;
+    }
+    return node;
+}
+
+Path Tokenize(const std::string &path)
+{
+    Path tokens;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find('.', start);
+        if (end == std::string::npos)
+            end = path.size();
+        if (end > start)
+            tokens.push_back(path.substr(start, end - start));
+        start = end + 1;
+    }
+    return tokens;
+}
+
+void Init(int argc, char **argv)
+{
+    const char *env = getenv("MCI_MOCK_LATENCY");
+    if (env != NULL)
+    {
+        if (sscanf(env, "%lf-%lf", &mock_latency_min, &mock_latency_max) < 2)
+            mock_latency_max = mock_latency_min;
+    }
+    env = getenv("MCI_MOCK_FAIL");
+    if (env != NULL)
+        mock_fail = atof(env);
+    env = getenv("MCI_MOCK_OUTAGE");
+    if (env != NULL)
+        if ((sscanf(env, "%lf,%lf", &mock_outage_period, &mock_outage_duration) != 2) ||
+            (mock_outage_duration >= mock_outage_period))
+            mock_outage_period = 0.0;
+    clock_gettime(CLOCK_MONOTONIC, &mock_start);
+    printf("MCI mock : latency %g-%g ms, failure probability %g, outage %g s every %g s\n",
+        mock_latency_min, mock_latency_max, mock_fail, mock_outage_duration, mock_outage_period);
+    pthread_mutex_lock(&mock_lock);
+    if (mock_root == NULL)
+    {
+        mock_root = new MockNode();
+        mock_root->type = eNvUndefined;
+        mock_root->live = false;
+        for (int i=0; i<MOCK_NUM_PARAMS; i++)
+        {
+            MockNode *node = mock_create(Tokenize(mock_params[i].path));
+            node->type = mock_params[i].type;
+            node->live = mock_params[i].live;
+            const char *v = mock_params[i].value;
+            switch (node->type)
+            {
+                case eNvBool : node->value.b = !strcmp(v, "true"); break;
+                case eNvLong : node->value.l = strtol(v, NULL, 0); break;
+                case eNvULong : node->value.u = strtoul(v, NULL, 0); break;
+                case eNvLongLong : node->value.i = strtoll(v, NULL, 0); break;
+                case eNvULongLong : node->value.ul = strtoull(v, NULL, 0); break;
+                case eNvDouble : node->value.d = strtod(v, NULL); break;
+                case eNvString : node->str = v; break;
+                default : break;
+            }
+            node->nominal = strtod(v, NULL);
+        }
+    }
+    pthread_mutex_unlock(&mock_lock);
+}
+
+Node Connect(const std::string &host, int port)
+{
+    pthread_mutex_lock(&mock_lock);
+    if (mock_outage())
+    {
+        pthread_mutex_unlock(&mock_lock);
+        return Node();
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return Node(mock_root);
+}
+
+// the tree is kept until the end, the server may still hold nodes
+void Shutdown()
+{
+}
+
+Node Node::GetNode(const Path &path) const
+{
+    pthread_mutex_lock(&mock_lock);
+    mock_call();
+    MockNode *node = m_node;
+    for (size_t i=0; (node != NULL) && (i<path.size()); i++)
+    {
+        MockNode *child = NULL;
+        for (size_t k=0; k<node->children.size(); k++)
+            if (node->children[k]->name == path[i])
+                child = node->children[k];
+        node = child;
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return Node(node);
+}
+
+std::string Node::GetName() const
+{
+    return (m_node != NULL) ? m_node->name : std::string();
+}
+
+std::vector<Node> Node::GetTreeNodes() const
+{
+    std::vector<Node> nodes;
+    if (m_node == NULL)
+        return nodes;
+    pthread_mutex_lock(&mock_lock);
+    mock_call();
+    for (size_t k=0; k<m_node->children.size(); k++)
+        nodes.push_back(Node(m_node->children[k]));
+    pthread_mutex_unlock(&mock_lock);
+    return nodes;
+}
+
+NodeValType_e Node::GetValueType() const
+{
+    return (m_node != NULL) ? m_node->type : eNvUndefined;
+}
+
+// the value access is the same for all numeric types, only the member differs
+#define MOCK_ACCESS(ctype, nvtype, member) \
+bool Node::GetValue(ctype &value) const \
+{ \
+    if ((m_node == NULL) || (m_node->type != nvtype)) \
+        return false; \
+    pthread_mutex_lock(&mock_lock); \
+    mock_call(); \
+    if (m_node->live) \
+    { \
+        double v = m_node->nominal * (0.99 + 0.02 * mock_random()); \
+        m_node->member = (ctype)v; \
+    } \
+    value = m_node->member; \
+    pthread_mutex_unlock(&mock_lock); \
+    return true; \
+} \
+bool Node::SetValue(const ctype &value) \
+{ \
+    if ((m_node == NULL) || (m_node->type != nvtype)) \
+        return false; \
+    pthread_mutex_lock(&mock_lock); \
+    mock_call(); \
+    m_node->member = value; \
+    pthread_mutex_unlock(&mock_lock); \
+    return true; \
+}
+
+MOCK_ACCESS(bool, eNvBool, value.b)
+MOCK_ACCESS(int32_t, eNvLong, value.l)
+MOCK_ACCESS(unsigned int, eNvULong, value.u)
+MOCK_ACCESS(int64_t, eNvLongLong, value.i)
+MOCK_ACCESS(uint64_t, eNvULongLong, value.ul)
+MOCK_ACCESS(double, eNvDouble, value.d)
+
+bool Node::GetValue(std::string &value) const
+{
+    if ((m_node == NULL) || (m_node->type != eNvString))
+        return false;
+    pthread_mutex_lock(&mock_lock);
+    mock_call();
+    value = m_node->str;
+    pthread_mutex_unlock(&mock_lock);
+    return true;
+}
+
+bool Node::SetValue(const std::string &value)
+{
+    if ((m_node == NULL) || (m_node->type != eNvString))
+        return false;
+    pthread_mutex_lock(&mock_lock);
+    mock_call();
+    m_node->str = value;
+    pthread_mutex_unlock(&mock_lock);
+    return true;
+}
+
+}
@@ -0,0 +1,106 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_mci_mock.h
+  OpcUaStreamServer : in-process replacement of the MCI library for host builds
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERAMCIMOCK_H
+#define LIBERAMCIMOCK_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+    This implements the part of the MCI interface used by the server
+    on top of an in-memory tree holding the parameters of a Libera Spark
+    application. It is selected by compiling with -DMCI_MOCK.
+
+    The behaviour of the LiberaBase connection is set by environment variables
+    read by mci::Init()
+    MCI_MOCK_LATENCY   time every call takes [ms], a range "min-max" gives
+                       uniformly distributed values (default 0)
+    MCI_MOCK_FAIL      probability that a call throws as if the connection
+                       was lost (default 0)
+    MCI_MOCK_OUTAGE    "period,duration" [s] : LiberaBase is unreachable for
+                       duration seconds at the end of every period
+*/
+
+namespace mci {
+
+enum NodeValType_e {
+    eNvUndefined,
+    eNvBool,
+    eNvLong,
+    eNvULong,
+    eNvLongLong,
+    eNvULongLong,
+    eNvDouble,
+    eNvString
+};
+
+typedef std::vector<std::string> Path;
+
+// split a dotted path into its components
+Path Tokenize(const std::string &path);
+
+struct MockNode;
+
+class Node {
+public:
+    Node() : m_node(NULL) {}
+    bool IsValid() const { return m_node != NULL; }
+    Node GetNode(const Path &path) const;
+    std::string GetName() const;
+    std::vector<Node> GetTreeNodes() const;
+    NodeValType_e GetValueType() const;
+    bool GetValue(bool &value) const;
+    bool GetValue(int32_t &value) const;
+    bool GetValue(unsigned int &value) const;
+    bool GetValue(int64_t &value) const;
+    bool GetValue(uint64_t &value) const;
+    bool GetValue(double &value) const;
+    bool GetValue(std::string &value) const;
+    bool SetValue(const bool &value);
+    bool SetValue(const int32_t &value);
+    bool SetValue(const unsigned int &value);
+    bool SetValue(const int64_t &value);
+    bool SetValue(const uint64_t &value);
+    bool SetValue(const double &value);
+    bool SetValue(const std::string &value);
+private:
+    explicit Node(MockNode *node) : m_node(node) {}
+    friend Node Connect(const std::string &host, int port);
+    MockNode *m_node;
+};
+
+void Init(int argc = 0, char **argv = 0);
+Node Connect(const std::string &host = "localhost", int port = 0);
+void Shutdown();
+
+}
+
+#endif
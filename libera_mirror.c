@@ -0,0 +1,335 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_mirror.c
+  OpcUaStreamServer : on-demand mirror of the MCI tree in the OPC-UA address space
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "libera_mci.h"
+#include "libera_mirror.h"
+#include "libera_nodes.h"
+
+/*
+    The MCI tree of the device holds thousands of nodes. Instead of creating
+    OPC-UA nodes for all of them at startup, the folder MCI only gets the
+    children of a node when a client looks at it.
+
+    The server does not provide a hook for browse requests. So the getNode()
+    routine of the node store is wrapped. Whenever the server accesses a
+    mirrored folder (e.g. to browse it or to describe it as a child of the
+    folder being browsed) which has not been expanded yet, a job is queued
+    for the MCI worker thread. The worker browses the MCI node and registers
+    its values with the MCI cache. A server callback then creates the OPC-UA
+    nodes of the browsed folders. As the children of a folder are requested
+    when the folder itself is browsed, they are usually ready when the client
+    descends into them.
+
+    MCI nodes having a value become variables, all others become folders.
+    Node IDs are strings in namespace 1 holding the MCI path,
+    e.g. "application.dsp.enable".
+*/
+
+// interval of the server callback creating the nodes of browsed folders [ms]
+#define MIRROR_POLL_MS 50
+
+// the mirrored parameters of one folder share this cache group (not a node ID)
+#define MIRROR_GROUP 0x80000000
+
+// the states of a mirrored folder
+enum { MIRROR_NEW, MIRROR_REQUESTED, MIRROR_BROWSED, MIRROR_EXPANDED };
+
+struct MirrorChild {
+    std::string name;
+    std::string path;
+    const MciParamInfo *info;       // NULL for folders
+};
+
+struct MirrorFolder {
+    std::string path;               // MCI path, empty for the root
+    int state;
+    std::vector<MirrorChild> children;  // filled by the worker, consumed by the server
+};
+
+// all folders, protected by mirror_lock, index 0 is the root
+static std::vector<MirrorFolder> mirror_folders;
+static std::map<std::string, int> mirror_index;
+static pthread_mutex_t mirror_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the original getNode() routine of the node store
+static const UA_Node *(*mirror_get_node_orig)(void *nsCtx, const UA_NodeId *nodeId) = NULL;
+
+static bool mirror_enabled = false;
+// set by the server thread while it creates the mirror nodes
+static bool mirror_adding = false;
+static unsigned int mirror_ttl = MIRROR_TTL;
+static UA_Byte mirror_access = UA_ACCESSLEVELMASK_READ;
+
+// statistics, protected by mirror_lock
+static int mirror_variables = 0;
+static int mirror_skipped = 0;
+
+// the node ID of a mirrored folder or variable
+static UA_NodeId mirror_node_id(const std::string &path)
+{
+    if (path.empty())
+        return UA_NODEID_NUMERIC(1, LIBERA_MIRROR_ID);
+    return UA_NODEID_STRING(1, (char *)path.c_str());
+}
+
+// a parameter of the registry has only one cache entry
+static const MciParamInfo *mirror_registry_param(const std::string &path)
+{
+    for (int i=0; i<mci_num_params(); i++)
+        if (path == mci_param_info(i)->path)
+            return mci_param_info(i);
+    return NULL;
+}
+
+// browse one folder, runs as a job on the MCI worker thread
+static void mirror_browse(void *arg)
+{
+    int folder = (int)(intptr_t)arg;
+    pthread_mutex_lock(&mirror_lock);
+    std::string path = mirror_folders[folder].path;
+    pthread_mutex_unlock(&mirror_lock);
+    std::vector<MirrorChild> children;
+    int skipped = 0;
+    mci::Node node;
+    std::vector<mci::Node> nodes;
+    bool ok = true;
+    try {
+        node = path.empty() ? mci_root() : mci_root().GetNode(mci::Tokenize(path));
+        if (node.IsValid())
+            nodes = node.GetTreeNodes();
+    } catch (...) {
+        ok = false;
+    }
+    if (ok && node.IsValid())
+    {
+        for (size_t i=0; i<nodes.size(); i++)
+        {
+            MirrorChild child;
+            try {
+                child.name = nodes[i].GetName();
+            } catch (...) {
+                skipped++;
+                continue;
+            }
+            child.path = path.empty() ? child.name : path + "." + child.name;
+            child.info = NULL;
+            int type = mci_node_type(nodes[i]);
+            if (type != MCI_NO_VALUE)
+            {
+                child.info = mirror_registry_param(child.path);
+                if (child.info == NULL)
+                    child.info = mci_add_param(nodes[i], child.path.c_str(), MIRROR_GROUP + folder,
+                        child.name.c_str(), type, mirror_access, mirror_ttl);
+                // values of other types (strings, enumerations) are not mirrored
+                if (child.info == NULL)
+                {
+                    skipped++;
+                    continue;
+                }
+            }
+            children.push_back(child);
+        }
+    }
+    else
+        printf("MCI mirror : cannot browse %s\n", path.c_str());
+    pthread_mutex_lock(&mirror_lock);
+    mirror_folders[folder].children.swap(children);
+    // a folder which could not be browsed is tried again on the next access
+    mirror_folders[folder].state = (ok && node.IsValid()) ? MIRROR_BROWSED : MIRROR_NEW;
+    mirror_skipped += skipped;
+    pthread_mutex_unlock(&mirror_lock);
+}
+
+// queue the browsing of a folder if not yet done, mirror_lock has to be held
+static void mirror_request(int folder)
+{
+    if (mirror_folders[folder].state != MIRROR_NEW)
+        return;
+    // if the queue is full, the request is repeated on the next access
+    if (mci_submit(mirror_browse, (void *)(intptr_t)folder))
+        mirror_folders[folder].state = MIRROR_REQUESTED;
+}
+
+// the wrapped getNode() routine of the node store
+static const UA_Node *mirror_get_node(void *nsCtx, const UA_NodeId *nodeId)
+{
+    if (mirror_enabled && !mirror_adding && (nodeId->namespaceIndex == 1))
+    {
+        if ((nodeId->identifierType == UA_NODEIDTYPE_NUMERIC) &&
+            (nodeId->identifier.numeric == LIBERA_MIRROR_ID))
+        {
+            pthread_mutex_lock(&mirror_lock);
+            mirror_request(0);
+            pthread_mutex_unlock(&mirror_lock);
+        }
+        else if (nodeId->identifierType == UA_NODEIDTYPE_STRING)
+        {
+            std::string path((const char *)nodeId->identifier.string.data, nodeId->identifier.string.length);
+            pthread_mutex_lock(&mirror_lock);
+            std::map<std::string, int>::iterator it = mirror_index.find(path);
+            if (it != mirror_index.end())
+                mirror_request(it->second);
+            pthread_mutex_unlock(&mirror_lock);
+        }
+    }
+    return mirror_get_node_orig(nsCtx, nodeId);
+}
+
+// create the nodes of all browsed folders, runs as a server callback
+static void mirror_expand(UA_Server *server, void *data)
+{
+    pthread_mutex_lock(&mirror_lock);
+    mirror_adding = true;
+    // folders appended in the loop are new and need not be checked
+    size_t num = mirror_folders.size();
+    for (size_t f=0; f<num; f++)
+    {
+        if (mirror_folders[f].state != MIRROR_BROWSED)
+            continue;
+        // copies, the folder list may be reallocated while adding folders
+        std::string parent = mirror_folders[f].path;
+        std::vector<MirrorChild> children;
+        children.swap(mirror_folders[f].children);
+        mirror_folders[f].state = MIRROR_EXPANDED;
+        for (size_t i=0; i<children.size(); i++)
+        {
+            MirrorChild *child = &children[i];
+            if (child->info == NULL)
+            {
+                UA_ObjectAttributes object_attr = UA_ObjectAttributes_default;
+                object_attr.description = UA_LOCALIZEDTEXT((char *)"en_US", (char *)child->path.c_str());
+                object_attr.displayName = UA_LOCALIZEDTEXT((char *)"en_US", (char *)child->name.c_str());
+                UA_StatusCode res = UA_Server_addObjectNode(server,
+                        mirror_node_id(child->path),
+                        mirror_node_id(parent),
+                        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                        UA_QUALIFIEDNAME(1, (char *)child->name.c_str()),
+                        UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                        object_attr,
+                        NULL, NULL);
+                if (res != UA_STATUSCODE_GOOD)
+                {
+                    printf("MCI mirror : failed to add %s\n", child->path.c_str());
+                    continue;
+                }
+                MirrorFolder folder;
+                folder.path = child->path;
+                folder.state = MIRROR_NEW;
+                mirror_index[child->path] = (int)mirror_folders.size();
+                mirror_folders.push_back(folder);
+            }
+            else
+            {
+                const MciParamInfo *info = child->info;
+                UA_VariableAttributes attr = UA_VariableAttributes_default;
+                attr.description = UA_LOCALIZEDTEXT((char *)"en_US", (char *)child->path.c_str());
+                attr.displayName = UA_LOCALIZEDTEXT((char *)"en_US", (char *)child->name.c_str());
+                attr.dataType = UA_TYPES[info->type].typeId;
+                attr.accessLevel = info->access;
+                UA_DataSource mciDataSource;
+                mciDataSource.read = mci_read;
+                mciDataSource.write = (info->access & UA_ACCESSLEVELMASK_WRITE) ? mci_write : NULL;
+                UA_StatusCode res = UA_Server_addDataSourceVariableNode(server,
+                        mirror_node_id(child->path),
+                        mirror_node_id(parent),
+                        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                        UA_QUALIFIEDNAME(1, (char *)child->name.c_str()),
+                        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                        attr,
+                        mciDataSource,
+                        (void *)info, NULL);
+                if (res != UA_STATUSCODE_GOOD)
+                {
+                    printf("MCI mirror : failed to add %s\n", child->path.c_str());
+                    continue;
+                }
+                mirror_variables++;
+            }
+        }
+    }
+    mirror_adding = false;
+    pthread_mutex_unlock(&mirror_lock);
+}
+
+void mirror_hook(UA_ServerConfig *config)
+{
+    mirror_get_node_orig = config->nodestore.getNode;
+    config->nodestore.getNode = mirror_get_node;
+}
+
+int mirror_init(UA_Server *server, unsigned int ttl_ms, bool writable)
+{
+    if (mirror_get_node_orig == NULL)
+    {
+        printf("MCI mirror : node store hook not installed\n");
+        return -1;
+    }
+    mirror_ttl = ttl_ms;
+    mirror_access = writable ? (UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE) : UA_ACCESSLEVELMASK_READ;
+    MirrorFolder root;
+    root.state = MIRROR_NEW;
+    mirror_folders.push_back(root);
+    // the root folder is only browsed when a client looks into it
+    UA_ObjectAttributes object_attr = UA_ObjectAttributes_default;
+    object_attr.description = UA_LOCALIZEDTEXT((char *)"en_US", (char *)"MCI tree of the device");
+    object_attr.displayName = UA_LOCALIZEDTEXT((char *)"en_US", (char *)"MCI");
+    UA_StatusCode res = UA_Server_addObjectNode(server,
+            UA_NODEID_NUMERIC(1, LIBERA_MIRROR_ID),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+            UA_QUALIFIEDNAME(1, (char *)"MCI"),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+            object_attr,
+            NULL, NULL);
+    if (res != UA_STATUSCODE_GOOD)
+        return -2;
+    if (UA_Server_addRepeatedCallback(server, mirror_expand, NULL, MIRROR_POLL_MS, NULL) != UA_STATUSCODE_GOOD)
+        return -3;
+    mirror_enabled = true;
+    return 0;
+}
+
+void mirror_free()
+{
+    pthread_mutex_lock(&mirror_lock);
+    if (mirror_enabled)
+        printf("MCI mirror : %d folders, %d variables, %d values not mirrored\n",
+            (int)mirror_folders.size(), mirror_variables, mirror_skipped);
+    mirror_enabled = false;
+    mirror_folders.clear();
+    mirror_index.clear();
+    pthread_mutex_unlock(&mirror_lock);
+}
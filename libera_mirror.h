@@ -0,0 +1,59 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_mirror.h
+  OpcUaStreamServer : on-demand mirror of the MCI tree in the OPC-UA address space
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERAMIRROR_H
+#define LIBERAMIRROR_H
+
+#include "open62541.h"       // the OPC UA library
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// default and maximum time-to-live of the cached values of mirrored parameters [ms]
+#define MIRROR_TTL 1000
+#define MIRROR_MAX_TTL 60000
+
+// install the expansion hook into the node store of the server configuration
+// has to be called before the server is created from the configuration
+void mirror_hook(UA_ServerConfig *config);
+
+// create the MCI root folder and start mirroring on demand
+// mirrored parameters are writable only if writable is true
+// returns 0 on success
+int mirror_init(UA_Server *server, unsigned int ttl_ms, bool writable);
+
+// release the mirror data after the server has been deleted
+void mirror_free();
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_neon_model.h
+  OpcUaStreamServer : portable model of the NEON intrinsics used by csum_partial()
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+
+  The vector path of csum_partial() can only run on the ARM target. For the host
+  build of csumtest the few intrinsics it uses are modelled here lane by lane,
+  with the wrap-around of the lanes as in the hardware. libera_udp.c includes
+  this header instead of arm_neon.h when it is compiled with -DCSUM_NEON_MODEL.
+ */
+
+#ifndef LIBERANEONMODEL_H
+#define LIBERANEONMODEL_H
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct { uint16_t val[8]; } uint16x8_t;
+typedef struct { uint32_t val[4]; } uint32x4_t;
+typedef struct { uint64_t val[2]; } uint64x2_t;
+
+static inline uint32x4_t vdupq_n_u32(uint32_t x)
+{
+    uint32x4_t r;
+    for (int i=0; i<4; i++) r.val[i] = x;
+    return r;
+}
+
+static inline uint64x2_t vdupq_n_u64(uint64_t x)
+{
+    uint64x2_t r;
+    for (int i=0; i<2; i++) r.val[i] = x;
+    return r;
+}
+
+// the hardware load needs no alignment beyond that of the pointer type
+static inline uint16x8_t vld1q_u16(const uint16_t *ptr)
+{
+    uint16x8_t r;
+    memcpy(r.val, ptr, sizeof(r.val));
+    return r;
+}
+
+// pairwise add of adjacent lanes of b, accumulated into the lanes of a
+static inline uint32x4_t vpadalq_u16(uint32x4_t a, uint16x8_t b)
+{
+    for (int i=0; i<4; i++)
+        a.val[i] += (uint32_t)b.val[2*i] + (uint32_t)b.val[2*i+1];
+    return a;
+}
+
+static inline uint64x2_t vpadalq_u32(uint64x2_t a, uint32x4_t b)
+{
+    for (int i=0; i<2; i++)
+        a.val[i] += (uint64_t)b.val[2*i] + (uint64_t)b.val[2*i+1];
+    return a;
+}
+
+#define vgetq_lane_u64(v, lane) ((v).val[(lane)])
+
+#endif
@@ -0,0 +1,121 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_nodes.h
+  OpcUaStreamServer : fixed node IDs of the OPC-UA address space
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERANODES_H
+#define LIBERANODES_H
+
+// all nodes are in namespace 1
+#define LIBERA_DEVICE_ID 49000
+#define LIBERA_DEVNAME_ID 49100
+#define LIBERA_DEVFREQ_ID 49200
+#define LIBERA_MCIHITS_ID 49300
+#define LIBERA_MCIMISSES_ID 49310
+#define LIBERA_MCICONNECTED_ID 49320
+#define LIBERA_MCIRECONNECTS_ID 49330
+#define LIBERA_SAVESNAPSHOT_ID 49400
+#define LIBERA_RESTORESNAPSHOT_ID 49410
+#define LIBERA_LISTSNAPSHOTS_ID 49420
+#define LIBERA_SIGNALS_ID  50000
+#define LIBERA_SP_ID  50100
+#define LIBERA_VA_ID  50101
+#define LIBERA_VB_ID  50102
+#define LIBERA_VC_ID  50103
+#define LIBERA_VD_ID  50104
+#define LIBERA_CHARGE_ID  50110
+#define LIBERA_POSX_ID  50120
+#define LIBERA_POSY_ID  50130
+#define LIBERA_SHAPEQ_ID  50140
+#define LIBERA_RECEIVETIME_ID  50150
+#define LIBERA_MAXADC_ID  50200
+#define LIBERA_HISTORY_ID  50300
+#define LIBERA_HIST_VA_ID  50301
+#define LIBERA_HIST_VB_ID  50302
+#define LIBERA_HIST_VC_ID  50303
+#define LIBERA_HIST_VD_ID  50304
+#define LIBERA_HIST_CHARGE_ID  50310
+#define LIBERA_HIST_POSX_ID  50320
+#define LIBERA_HIST_POSY_ID  50330
+#define LIBERA_HIST_SHAPEQ_ID  50340
+#define LIBERA_HIST_TRIGGERCNT_ID  50350
+#define LIBERA_HIST_TIME_ID  50360
+#define LIBERA_STREAM_ID 51000
+#define LIBERA_STREAMSTATUS_ID 51100
+#define LIBERA_STREAMERROR_ID 51110
+#define LIBERA_SOURCEIDLE_ID 51120
+#define LIBERA_ARRIVALJITTER_ID 51130
+#define LIBERA_ARRIVALJITTERPEAK_ID 51140
+#define LIBERA_SOURCEIP_ID 51200
+#define LIBERA_SOURCEPORT_ID 51210
+#define LIBERA_TARGETIP_ID 51300
+#define LIBERA_TARGETPORT_ID 51310
+#define LIBERA_TRANSMIT_ID 51400
+#define LIBERA_STREAMMODE_ID 51500
+#define LIBERA_STREAMBATCH_ID 51510
+#define LIBERA_PACKETRECORDS_ID 51520
+#define LIBERA_LATENCY_ID 51530
+#define LIBERA_STATISTICS_ID 51600
+// counter i of the Stream/Statistics folder is LIBERA_STATISTICS_ID + (i+1)*LIBERA_STAT_STEP
+// its rate (if published) is LIBERA_STAT_RATE_ID + (i+1)*LIBERA_STAT_STEP
+#define LIBERA_STAT_RATE_ID 51800
+#define LIBERA_STAT_STEP 10
+#define LIBERA_SEQUENCEEVENTS_ID 51990
+#define LIBERA_LOSSEVENTTYPE_ID 51995
+#define LIBERA_DSP_ID 52000
+#define LIBERA_DSP_ENABLE_ID 52010
+#define LIBERA_DSP_THR1_ID 52020
+#define LIBERA_DSP_PRE_ID 52030
+#define LIBERA_DSP_POST1_ID 52040
+#define LIBERA_DSP_TIMEOUT_ID 52050
+#define LIBERA_DSP_AVERAGING_ID 52060
+#define LIBERA_CAL_ID 54000
+#define LIBERA_CAL_ATT_ID 54010
+#define LIBERA_CAL_KA_ID 54110
+#define LIBERA_CAL_KB_ID 54120
+#define LIBERA_CAL_KC_ID 54130
+#define LIBERA_CAL_KD_ID 54140
+#define LIBERA_CAL_LINX_ID 54210
+#define LIBERA_CAL_LINY_ID 54220
+#define LIBERA_CAL_LINQ_ID 54230
+#define LIBERA_CAL_LINS_ID 54240
+#define LIBERA_CAL_OFFX_ID 54310
+#define LIBERA_CAL_OFFY_ID 54320
+#define LIBERA_CAL_OFFQ_ID 54330
+#define LIBERA_CAL_OFFS_ID 54340
+#define LIBERA_CAL_APPLY_ID 54500
+#define LIBERA_DIAGNOSTICS_ID 55000
+#define LIBERA_DIAG_RESET_ID 55010
+// the folder of latency stage i is LIBERA_DIAG_STAGE_ID + i*LIBERA_DIAG_STAGE_STEP
+// its variables Count, P50, P99, P999, Max follow in steps of LIBERA_DIAG_VALUE_STEP
+#define LIBERA_DIAG_STAGE_ID 55100
+#define LIBERA_DIAG_STAGE_STEP 100
+#define LIBERA_DIAG_VALUE_STEP 10
+// the children of the MCI mirror folder have string node IDs (the MCI path)
+#define LIBERA_MIRROR_ID 60000
+
+#endif
@@ -0,0 +1,172 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_realtime.c
+  OpcUaStreamServer : real-time scheduling of the stream threads
+  and the arrival jitter of the stream records
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "libera_realtime.h"
+
+int rt_lock_memory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        perror("OpcUaServer : mlockall()");
+        return -1;
+    }
+    return 0;
+}
+
+// the start routine and argument of a thread together with its configuration
+typedef struct {
+    void *(*start)(void *);
+    void *arg;
+    size_t prefault;
+} RtThreadStart;
+
+// touch every page of the stack, so it is mapped before the thread starts working
+static void rt_prefault_stack(size_t size)
+{
+    volatile char stack[size];
+    for (size_t i=0; i<size; i+=4096)
+        stack[i] = 0;
+    (void)stack[0];
+}
+
+static void* rt_thread_start(void *arg)
+{
+    RtThreadStart start = *(RtThreadStart *)arg;
+    free(arg);
+    if (start.prefault > 0)
+        rt_prefault_stack(start.prefault);
+    return start.start(start.arg);
+}
+
+int rt_thread_create(pthread_t *tid, const char *name, const RtThreadConfig *config,
+                     void *(*start)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (config->priority > 0)
+    {
+        struct sched_param param = { .sched_priority = config->priority };
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    if (config->cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config->cpu, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpus);
+    }
+    RtThreadStart *ts = malloc(sizeof(RtThreadStart));
+    if (ts == NULL)
+    {
+        pthread_attr_destroy(&attr);
+        return -1;
+    }
+    ts->start = start;
+    ts->arg = arg;
+    ts->prefault = 0;
+    if (config->stack > 0)
+    {
+        pthread_attr_setstacksize(&attr, config->stack);
+        if (config->stack > RT_STACK_MARGIN)
+            ts->prefault = config->stack - RT_STACK_MARGIN;
+    }
+    int res = pthread_create(tid, &attr, &rt_thread_start, ts);
+    pthread_attr_destroy(&attr);
+    if (res != 0)
+    {
+        // most likely we are not allowed to use SCHED_FIFO
+        fprintf(stderr, "OpcUaServer : %s thread attributes refused (%s), using defaults\n", name, strerror(res));
+        ts->prefault = 0;
+        res = pthread_create(tid, NULL, &rt_thread_start, ts);
+    }
+    if (res != 0)
+    {
+        free(ts);
+        return -1;
+    }
+    if ((config->priority > 0) || (config->cpu >= 0))
+        printf("OpcUaServer : %s thread priority=%d cpu=%d\n", name, config->priority, config->cpu);
+    return 0;
+}
+
+void jitter_init(RtJitter *jitter)
+{
+    memset(jitter, 0, sizeof(RtJitter));
+    pthread_mutex_init(&jitter->mutex, NULL);
+}
+
+void jitter_add(RtJitter *jitter, int64_t latency, uint64_t now)
+{
+    if (now >= jitter->window_end)
+    {
+        if (jitter->n > 0)
+        {
+            double mean = jitter->sum / jitter->n;
+            double var = jitter->sumsq / jitter->n - mean * mean;
+            pthread_mutex_lock(&jitter->mutex);
+            jitter->rms_us = (var > 0.0) ? sqrt(var) * 1e-3 : 0.0;
+            jitter->peak_us = (double)(jitter->max - jitter->min) * 1e-3;
+            pthread_mutex_unlock(&jitter->mutex);
+        }
+        jitter->window_end = now + (uint64_t)RT_JITTER_WINDOW_MS * 1000000;
+        jitter->reference = latency;
+        jitter->n = 0;
+        jitter->sum = 0.0;
+        jitter->sumsq = 0.0;
+        jitter->min = latency;
+        jitter->max = latency;
+    }
+    // relative to the first latency of the window to keep the precision
+    double d = (double)(latency - jitter->reference);
+    jitter->n++;
+    jitter->sum += d;
+    jitter->sumsq += d * d;
+    if (latency < jitter->min) jitter->min = latency;
+    if (latency > jitter->max) jitter->max = latency;
+}
+
+void jitter_get(RtJitter *jitter, double *rms_us, double *peak_us)
+{
+    pthread_mutex_lock(&jitter->mutex);
+    *rms_us = jitter->rms_us;
+    *peak_us = jitter->peak_us;
+    pthread_mutex_unlock(&jitter->mutex);
+}
@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_realtime.h
+  OpcUaStreamServer : real-time scheduling of the stream threads
+  and the arrival jitter of the stream records
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERAREALTIME_H
+#define LIBERAREALTIME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    The stream reader and the consumer stages can be run with the SCHED_FIFO
+    policy and pinned to one CPU, so they are not delayed by the OPC UA server
+    thread, LiberaBase and omniORB. The stack of such a thread can be
+    prefaulted when the thread starts, and with rt_lock_memory() all pages
+    of the process are locked, so no page faults occur while streaming.
+*/
+
+// range of the SCHED_FIFO priorities
+#define RT_MIN_PRIORITY 1
+#define RT_MAX_PRIORITY 99
+
+// maximum stack size of a thread [bytes]
+#define RT_MAX_STACK (8*1024*1024)
+// part of the stack not prefaulted, already used by the thread start [bytes]
+#define RT_STACK_MARGIN 16384
+
+typedef struct {
+    int priority;               // SCHED_FIFO priority, 0 for the default scheduling
+    int cpu;                    // the CPU the thread is pinned to, -1 for any
+    size_t stack;               // size of the prefaulted stack [bytes], 0 for the default stack
+} RtThreadConfig;
+
+#define RT_THREAD_DEFAULT { .priority = 0, .cpu = -1, .stack = 0 }
+
+// lock all current and future pages of the process into memory
+// returns 0 on success
+int rt_lock_memory();
+
+// create a thread with the given scheduling, affinity and stack
+// should the attributes be refused (e.g. missing privileges)
+// the thread is created with default attributes and a warning is printed
+// returns 0 on success
+int rt_thread_create(pthread_t *tid, const char *name, const RtThreadConfig *config,
+                     void *(*start)(void *), void *arg);
+
+/*
+    The arrival jitter is the variation of the latency between the hardware
+    time stamp of a record and its reception by the stream reader. A constant
+    offset between the clocks of the FPGA and the CPU does not matter.
+    The reader adds the latency of every record, the statistics of all
+    records received within RT_JITTER_WINDOW_MS are published together
+    when the first record of the next window arrives.
+*/
+
+#define RT_JITTER_WINDOW_MS 1000
+
+typedef struct {
+    pthread_mutex_t mutex;
+    // accumulated by the reader
+    uint64_t window_end;        // [ns]
+    int64_t reference;          // first latency of the window, the others are taken relative to it
+    uint32_t n;
+    double sum;
+    double sumsq;
+    int64_t min;
+    int64_t max;
+    // statistics of the last complete window, protected by the mutex
+    double rms_us;              // RMS deviation from the mean latency
+    double peak_us;             // difference between the maximum and minimum latency
+} RtJitter;
+
+void jitter_init(RtJitter *jitter);
+
+// add the latency of one record received at time now (both in ns)
+void jitter_add(RtJitter *jitter, int64_t latency, uint64_t now);
+
+// get the statistics of the last complete window [us]
+void jitter_get(RtJitter *jitter, double *rms_us, double *peak_us);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
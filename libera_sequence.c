@@ -0,0 +1,140 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_sequence.c
+  OpcUaStreamServer : checking the sequence of the trigger counter
+  of the stream records and keeping the recent sequence events
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#include <string.h>
+
+#include "libera_sequence.h"
+
+static const char *sequence_kind_names[] = { "gap", "reorder", "duplicate", "reset" };
+
+void sequence_init(SequenceCheck *seq)
+{
+    memset(seq, 0, sizeof(SequenceCheck));
+}
+
+const char *sequence_kind_name(uint32_t kind)
+{
+    if (kind > SEQUENCE_RESET)
+        return "unknown";
+    return sequence_kind_names[kind];
+}
+
+// append an event to the ring
+static void sequence_event(SequenceCheck *seq, uint32_t kind, uint32_t received, uint32_t missed, uint64_t time)
+{
+    uint64_t count = seq->event_count;
+    SequenceEvent *event = &seq->events[count % SEQUENCE_EVENTS];
+    // the slot must not be modified before the previous count update is visible
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    event->time = time;
+    event->kind = kind;
+    event->expected = seq->expected;
+    event->received = received;
+    event->missed = missed;
+    __atomic_store_n(&seq->event_count, count+1, __ATOMIC_RELEASE);
+}
+
+int sequence_check(SequenceCheck *seq, const struct single_pass_data *record, uint64_t received)
+{
+    uint32_t count = record->trigger_cnt;
+    int kind = -1;
+    if (!seq->started)
+    {
+        seq->started = 1;
+        seq->expected = count + 1;
+        // counts before the start are not missing
+        seq->window = ~(uint64_t)0;
+        return -1;
+    }
+    // the differences are computed modulo 2^32, the counter may wrap around
+    uint32_t ahead = count - seq->expected;
+    uint32_t behind = seq->expected - 1 - count;
+    if (ahead == 0)
+    {
+        seq->window = (seq->window << 1) | 1;
+        seq->expected = count + 1;
+        return -1;
+    }
+    if (ahead <= SEQUENCE_MAX_GAP)
+    {
+        kind = SEQUENCE_GAP;
+        counter_add(&seq->gaps, 1);
+        counter_add(&seq->missed, ahead);
+        sequence_event(seq, SEQUENCE_GAP, count, ahead, received);
+        seq->window = (ahead + 1 < 64) ? (seq->window << (ahead + 1)) | 1 : 1;
+        seq->expected = count + 1;
+    }
+    else if (behind < SEQUENCE_WINDOW)
+    {
+        uint64_t bit = (uint64_t)1 << behind;
+        if (seq->window & bit)
+        {
+            kind = SEQUENCE_DUPLICATE;
+            counter_add(&seq->duplicates, 1);
+        }
+        else
+        {
+            // the count was accounted as missed when it was skipped
+            kind = SEQUENCE_REORDER;
+            counter_add(&seq->reordered, 1);
+            __atomic_store_n(&seq->missed, seq->missed - 1, __ATOMIC_RELAXED);
+            seq->window |= bit;
+        }
+        sequence_event(seq, kind, count, 0, received);
+    }
+    else
+    {
+        kind = SEQUENCE_RESET;
+        counter_add(&seq->resets, 1);
+        sequence_event(seq, SEQUENCE_RESET, count, 0, received);
+        seq->window = ~(uint64_t)0;
+        seq->expected = count + 1;
+    }
+    return kind;
+}
+
+uint32_t sequence_events(const SequenceCheck *seq, SequenceEvent *dst, uint32_t n)
+{
+    uint64_t count, oldest;
+    do {
+        count = __atomic_load_n(&seq->event_count, __ATOMIC_ACQUIRE);
+        uint32_t length = (count < SEQUENCE_EVENTS) ? (uint32_t)count : SEQUENCE_EVENTS;
+        if (n > length)
+            n = length;
+        for (uint32_t i=0; i<n; i++)
+            dst[i] = seq->events[(count - 1 - i) % SEQUENCE_EVENTS];
+        oldest = count - n;
+        // make sure the copy is complete before checking the count again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        count = __atomic_load_n(&seq->event_count, __ATOMIC_RELAXED);
+        // the writer may have overwritten the oldest copied event meanwhile
+    } while ((n > 0) && (oldest + SEQUENCE_EVENTS <= count));
+    return n;
+}
@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_sequence.h
+  OpcUaStreamServer : checking the sequence of the trigger counter
+  of the stream records and keeping the recent sequence events
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERASEQUENCE_H
+#define LIBERASEQUENCE_H
+
+#include <stdint.h>
+
+#include "libera_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    Every record carries the trigger counter, which advances by one per shot.
+    The checker tracks the next expected count and a bitmap of the last
+    SEQUENCE_WINDOW counts, so it can tell
+    gap : counts have been skipped, they are accounted as missed
+    reorder : a count skipped before has arrived late, it is no longer missed
+    duplicate : a count already received arrives again
+    reset : the counter jumped back further than the window or forward
+            by more than SEQUENCE_MAX_GAP (timing restarted)
+    The bunch counter of the records is not checked, it does not advance
+    from record to record (it is constant with one bunch per trigger).
+
+    The checker has a single writer, all counters can be read at any time
+    with counter_get(). The recent events are kept in a small ring which is
+    read like the shot history, a reader never blocks the writer.
+*/
+
+// kinds of sequence events
+#define SEQUENCE_GAP 0
+#define SEQUENCE_REORDER 1
+#define SEQUENCE_DUPLICATE 2
+#define SEQUENCE_RESET 3
+
+// number of trigger counts behind the expected one which can still arrive late
+#define SEQUENCE_WINDOW 64
+
+// forward jumps of more counts are taken as a reset of the counter, not as a gap
+#define SEQUENCE_MAX_GAP 0x1000000
+
+// number of recent events kept
+#define SEQUENCE_EVENTS 32
+
+typedef struct {
+    uint64_t time;              // receive time [ns since the unix epoch]
+    uint32_t kind;              // SEQUENCE_GAP ... SEQUENCE_RESET
+    uint32_t expected;          // the trigger count expected
+    uint32_t received;          // the trigger count received
+    uint32_t missed;            // number of counts skipped (gaps only)
+} SequenceEvent;
+
+typedef struct {
+    // counters, read them with counter_get()
+    uint64_t gaps;              // gap events
+    uint64_t missed;            // trigger counts missing (not arrived late)
+    uint64_t reordered;         // records which arrived late
+    uint64_t duplicates;        // records repeating a count
+    uint64_t resets;            // resets of the trigger counter
+    // state of the writer
+    int started;
+    uint32_t expected;          // next expected trigger count
+    uint64_t window;            // bit i set : count expected-1-i has been received
+    // the recent events
+    SequenceEvent events[SEQUENCE_EVENTS];
+    uint64_t event_count;
+} SequenceCheck;
+
+// initialize the checker, the first record starts the sequence
+void sequence_init(SequenceCheck *seq);
+
+// check one record received at the given time [ns since the unix epoch]
+// returns the kind of event or -1 if the record is in sequence
+int sequence_check(SequenceCheck *seq, const struct single_pass_data *record, uint64_t received);
+
+// copy up to n of the recent events into dst, the newest first
+// returns the number of events copied
+uint32_t sequence_events(const SequenceCheck *seq, SequenceEvent *dst, uint32_t n);
+
+// a short name of the event kind
+const char *sequence_kind_name(uint32_t kind);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
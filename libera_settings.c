@@ -0,0 +1,374 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_settings.c
+  OpcUaStreamServer : snapshots of the DSP and calibration settings stored in nvram
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include "libera_mci.h"
+#include "libera_nodes.h"
+#include "libera_settings.h"
+
+/*
+    A snapshot holds the values of all writable MCI parameters in the DSP and
+    Calibration folders. It is stored as a small XML file
+
+    <snapshot device="LA1-DSL.02" time="2017-01-01T12:00:00Z">
+        <param path="application.calibration.ka" value="1"/>
+        ...
+    </snapshot>
+
+    The values are read from the device with one job of the MCI worker and
+    restored with one batched write, which is verified by reading back.
+    Parameters are identified by their MCI path, so snapshots remain valid
+    if parameters are added to the registry.
+*/
+
+// the parameters included in the snapshots
+#define SETTINGS_MAX_PARAMS 64
+static const MciParamInfo *settings_params[SETTINGS_MAX_PARAMS];
+static int settings_num_params = 0;
+
+static char settings_device[80] = "";
+static char settings_dir[256] = "/nvram/cfg";
+
+// storage for the value of one parameter
+typedef union {
+    UA_Boolean b;
+    UA_Int32 i32;
+    UA_UInt32 u32;
+    UA_Int64 i64;
+    UA_UInt64 u64;
+    UA_Double d;
+} SettingsValue;
+
+int settings_init(const UA_String *device, const char *dir)
+{
+    snprintf(settings_dir, sizeof(settings_dir), "%s", dir);
+    size_t len = device->length < sizeof(settings_device)-1 ? device->length : sizeof(settings_device)-1;
+    memcpy(settings_device, device->data, len);
+    settings_device[len] = '\0';
+    settings_num_params = 0;
+    for (int i=0; i<mci_num_params(); i++)
+    {
+        const MciParamInfo *info = mci_param_info(i);
+        if ((info->parent != LIBERA_DSP_ID) && (info->parent != LIBERA_CAL_ID))
+            continue;
+        if (!(info->access & UA_ACCESSLEVELMASK_WRITE))
+            continue;
+        if (settings_num_params < SETTINGS_MAX_PARAMS)
+            settings_params[settings_num_params++] = info;
+    }
+    return settings_num_params;
+}
+
+// get the snapshot name from a method argument and check it
+// returns 0 if it is a valid name
+static int settings_name(const UA_Variant *arg, char *name)
+{
+    if (!UA_Variant_hasScalarType(arg, &UA_TYPES[UA_TYPES_STRING]))
+        return -1;
+    const UA_String *str = (const UA_String *)arg->data;
+    if ((str->length == 0) || (str->length > SETTINGS_MAX_NAME))
+        return -2;
+    for (size_t i=0; i<str->length; i++)
+    {
+        char c = (char)str->data[i];
+        if (!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+              ((c >= '0') && (c <= '9')) || (c == '-') || (c == '_')))
+            return -3;
+        name[i] = c;
+    }
+    name[str->length] = '\0';
+    return 0;
+}
+
+static void settings_filename(const char *name, char *filename, size_t size)
+{
+    snprintf(filename, size, "%s/snapshot-%s.xml", settings_dir, name);
+}
+
+// the text representation of a value
+static void settings_format(const UA_Variant *value, int type, char *buf, size_t size)
+{
+    switch (type)
+    {
+        case UA_TYPES_BOOLEAN : snprintf(buf, size, "%s", *(UA_Boolean *)value->data ? "true" : "false"); break;
+        case UA_TYPES_INT32 : snprintf(buf, size, "%d", *(UA_Int32 *)value->data); break;
+        case UA_TYPES_UINT32 : snprintf(buf, size, "%u", *(UA_UInt32 *)value->data); break;
+        case UA_TYPES_INT64 : snprintf(buf, size, "%lld", (long long)*(UA_Int64 *)value->data); break;
+        case UA_TYPES_UINT64 : snprintf(buf, size, "%llu", (unsigned long long)*(UA_UInt64 *)value->data); break;
+        // enough digits to restore the exact value
+        case UA_TYPES_DOUBLE : snprintf(buf, size, "%.17g", *(UA_Double *)value->data); break;
+        default : buf[0] = '\0';
+    }
+}
+
+// parse the text representation of a value
+// returns 0 on success
+static int settings_parse(const char *text, int type, SettingsValue *val)
+{
+    char c;
+    long long ll;
+    unsigned long long ull;
+    switch (type)
+    {
+        case UA_TYPES_BOOLEAN :
+            if (! strcmp(text, "true")) val->b = true;
+            else if (! strcmp(text, "false")) val->b = false;
+            else return -1;
+            return 0;
+        case UA_TYPES_INT32 :
+            return (sscanf(text, "%d%c", &val->i32, &c) == 1) ? 0 : -1;
+        case UA_TYPES_UINT32 :
+            return (sscanf(text, "%u%c", &val->u32, &c) == 1) ? 0 : -1;
+        case UA_TYPES_INT64 :
+            if (sscanf(text, "%lld%c", &ll, &c) != 1) return -1;
+            val->i64 = ll;
+            return 0;
+        case UA_TYPES_UINT64 :
+            if (sscanf(text, "%llu%c", &ull, &c) != 1) return -1;
+            val->u64 = ull;
+            return 0;
+        case UA_TYPES_DOUBLE :
+            return (sscanf(text, "%lf%c", &val->d, &c) == 1) ? 0 : -1;
+    }
+    return -1;
+}
+
+// save the values of all parameters into the snapshot file
+static UA_StatusCode settings_save(const char *name, UA_UInt32 *count)
+{
+    UA_Variant values[SETTINGS_MAX_PARAMS];
+    UA_StatusCode status[SETTINGS_MAX_PARAMS];
+    char filename[256];
+    char tempname[260];
+    char buf[80];
+    *count = 0;
+    for (int i=0; i<settings_num_params; i++)
+        UA_Variant_init(&values[i]);
+    UA_StatusCode res = mci_read_set(settings_num_params, settings_params, values, status, SETTINGS_TIMEOUT);
+    // an incomplete snapshot is not saved
+    for (int i=0; (res == UA_STATUSCODE_GOOD) && (i<settings_num_params); i++)
+        if (status[i] != UA_STATUSCODE_GOOD)
+        {
+            printf("OpcUaServer : failed to read %s for the snapshot\n", settings_params[i]->path);
+            res = status[i];
+        }
+    if (res == UA_STATUSCODE_GOOD)
+    {
+        xmlDocPtr doc = xmlNewDoc("1.0");
+        xmlNodePtr root = xmlNewNode(NULL, "snapshot");
+        xmlDocSetRootElement(doc, root);
+        xmlNewProp(root, "device", settings_device);
+        time_t now = time(NULL);
+        struct tm utc;
+        gmtime_r(&now, &utc);
+        strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        xmlNewProp(root, "time", buf);
+        for (int i=0; i<settings_num_params; i++)
+        {
+            xmlNodePtr node = xmlNewChild(root, NULL, "param", NULL);
+            xmlNewProp(node, "path", settings_params[i]->path);
+            settings_format(&values[i], settings_params[i]->type, buf, sizeof(buf));
+            xmlNewProp(node, "value", buf);
+        }
+        // write a temporary file first, so an existing snapshot is replaced only when complete
+        settings_filename(name, filename, sizeof(filename));
+        snprintf(tempname, sizeof(tempname), "%s.tmp", filename);
+        if (xmlSaveFormatFileEnc(tempname, doc, "UTF-8", 1) < 0)
+            res = UA_STATUSCODE_BADINTERNALERROR;
+        else if (rename(tempname, filename) != 0)
+        {
+            remove(tempname);
+            res = UA_STATUSCODE_BADINTERNALERROR;
+        }
+        else
+            *count = settings_num_params;
+        xmlFreeDoc(doc);
+        if (res != UA_STATUSCODE_GOOD)
+            printf("OpcUaServer : failed to write %s\n", filename);
+    }
+    for (int i=0; i<settings_num_params; i++)
+        UA_Variant_clear(&values[i]);
+    return res;
+}
+
+// restore all parameters found in the snapshot file
+// status[] receives the result for all parameters in the order of settings_params
+static UA_StatusCode settings_restore(const char *name, UA_StatusCode *status)
+{
+    SettingsValue storage[SETTINGS_MAX_PARAMS];
+    UA_Variant values[SETTINGS_MAX_PARAMS];
+    const MciParamInfo *params[SETTINGS_MAX_PARAMS];
+    UA_StatusCode results[SETTINGS_MAX_PARAMS];
+    int index[SETTINGS_MAX_PARAMS];
+    int n = 0;
+    char filename[256];
+    for (int i=0; i<settings_num_params; i++)
+        status[i] = UA_STATUSCODE_BADNOTFOUND;
+    settings_filename(name, filename, sizeof(filename));
+    xmlDocPtr doc = xmlReadFile(filename, NULL, 0);
+    if (doc == NULL)
+        return UA_STATUSCODE_BADNOTFOUND;
+    UA_StatusCode res = UA_STATUSCODE_GOOD;
+    xmlNode *rootNode = xmlDocGetRootElement(doc);
+    if ((rootNode == NULL) || strcmp(rootNode->name, "snapshot"))
+        res = UA_STATUSCODE_BADINVALIDARGUMENT;
+    for (xmlNode *currNode = rootNode ? rootNode->children : NULL; currNode && (res == UA_STATUSCODE_GOOD); currNode = currNode->next)
+    {
+        if ((currNode->type != XML_ELEMENT_NODE) || strcmp(currNode->name, "param"))
+            continue;
+        xmlChar *pathProp = xmlGetProp(currNode, "path");
+        xmlChar *valueProp = xmlGetProp(currNode, "value");
+        int found = -1;
+        for (int i=0; (pathProp != NULL) && (i<settings_num_params); i++)
+            if (! strcmp(pathProp, settings_params[i]->path))
+                found = i;
+        if (found < 0)
+            printf("OpcUaServer : snapshot %s has unknown parameter %s\n", name, pathProp ? (char *)pathProp : "");
+        else if ((valueProp == NULL) || (settings_parse(valueProp, settings_params[found]->type, &storage[n]) != 0))
+        {
+            printf("OpcUaServer : snapshot %s has invalid value for %s\n", name, pathProp);
+            status[found] = UA_STATUSCODE_BADINVALIDARGUMENT;
+            res = UA_STATUSCODE_BADINVALIDARGUMENT;
+        }
+        else if (status[found] == UA_STATUSCODE_BADNOTFOUND)
+        {
+            params[n] = settings_params[found];
+            UA_Variant_setScalar(&values[n], &storage[n], &UA_TYPES[settings_params[found]->type]);
+            index[n] = found;
+            status[found] = UA_STATUSCODE_GOOD;
+            n++;
+        }
+        if (pathProp != NULL) xmlFree(pathProp);
+        if (valueProp != NULL) xmlFree(valueProp);
+    }
+    xmlFreeDoc(doc);
+    // nothing is written unless the whole snapshot is valid
+    if (res != UA_STATUSCODE_GOOD)
+        return res;
+    res = mci_write_set(n, params, values, results, SETTINGS_TIMEOUT);
+    for (int k=0; k<n; k++)
+        status[index[k]] = results[k];
+    return res;
+}
+
+// compare two strings for qsort()
+static int settings_compare(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+UA_StatusCode saveSnapshot(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output)
+{
+    char name[SETTINGS_MAX_NAME+1];
+    UA_UInt32 count = 0;
+    if ((inputSize < 1) || (settings_name(&input[0], name) != 0))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    UA_StatusCode res = settings_save(name, &count);
+    if (res == UA_STATUSCODE_GOOD)
+        printf("OpcUaServer : saved snapshot %s with %d parameters\n", name, count);
+    UA_Variant_setScalarCopy(&output[0], &count, &UA_TYPES[UA_TYPES_UINT32]);
+    return res;
+}
+
+UA_StatusCode restoreSnapshot(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output)
+{
+    char name[SETTINGS_MAX_NAME+1];
+    UA_StatusCode status[SETTINGS_MAX_PARAMS];
+    UA_String paths[SETTINGS_MAX_PARAMS];
+    if ((inputSize < 1) || (settings_name(&input[0], name) != 0))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    UA_StatusCode res = settings_restore(name, status);
+    if (res == UA_STATUSCODE_GOOD)
+        printf("OpcUaServer : restored snapshot %s\n", name);
+    else
+        printf("OpcUaServer : failed to restore snapshot %s %8x\n", name, res);
+    for (int i=0; i<settings_num_params; i++)
+        paths[i] = UA_STRING((char *)settings_params[i]->path);
+    UA_Variant_setArrayCopy(&output[0], paths, settings_num_params, &UA_TYPES[UA_TYPES_STRING]);
+    UA_Variant_setArrayCopy(&output[1], status, settings_num_params, &UA_TYPES[UA_TYPES_STATUSCODE]);
+    return res;
+}
+
+UA_StatusCode listSnapshots(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output)
+{
+    char *names[256];
+    size_t n = 0;
+    DIR *dir = opendir(settings_dir);
+    if (dir == NULL)
+        return UA_STATUSCODE_BADNOTFOUND;
+    struct dirent *entry;
+    while (((entry = readdir(dir)) != NULL) && (n < sizeof(names)/sizeof(names[0])))
+    {
+        size_t len = strlen(entry->d_name);
+        // snapshot-<name>.xml
+        if ((len <= 13) || strncmp(entry->d_name, "snapshot-", 9) || strcmp(entry->d_name + len - 4, ".xml"))
+            continue;
+        names[n] = strndup(entry->d_name + 9, len - 13);
+        if (names[n] != NULL) n++;
+    }
+    closedir(dir);
+    qsort(names, n, sizeof(char *), settings_compare);
+    UA_String *list = (UA_String *)UA_Array_new(n, &UA_TYPES[UA_TYPES_STRING]);
+    for (size_t i=0; (list != NULL) && (i<n); i++)
+        list[i] = UA_STRING_ALLOC(names[i]);
+    for (size_t i=0; i<n; i++)
+        free(names[i]);
+    if (list == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_Variant_setArray(&output[0], list, n, &UA_TYPES[UA_TYPES_STRING]);
+    return UA_STATUSCODE_GOOD;
+}
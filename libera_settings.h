@@ -0,0 +1,88 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_settings.h
+  OpcUaStreamServer : snapshots of the DSP and calibration settings stored in nvram
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERASETTINGS_H
+#define LIBERASETTINGS_H
+
+#include "open62541.h"       // the OPC UA library
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the snapshots are stored as <dir>/snapshot-<name>.xml
+// where dir is the directory of the configuration file
+// maximum length of a snapshot name, only letters, digits, '-' and '_' are allowed
+#define SETTINGS_MAX_NAME 64
+// maximum time to wait for the MCI worker [ms]
+#define SETTINGS_TIMEOUT 5000
+
+// collect the writable parameters of the DSP and Calibration folders
+// the device name is recorded in the snapshot files, which are stored in dir
+// returns the number of parameters included in the snapshots
+int settings_init(const UA_String *device, const char *dir);
+
+// save the current values of all parameters as snapshot
+// input : Name (String)
+// output : Parameters (UInt32) number of saved values
+UA_StatusCode saveSnapshot(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output);
+
+// write all values of a snapshot to the device with one batch
+// input : Name (String)
+// output : Parameters (String[]) MCI paths of all parameters
+//          Status (StatusCode[]) result for every parameter, BadNotFound if not in the snapshot
+UA_StatusCode restoreSnapshot(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output);
+
+// the names of all stored snapshots
+// output : Names (String[])
+UA_StatusCode listSnapshots(
+    UA_Server *server,
+    const UA_NodeId *sessionId, void *sessionContext,
+    const UA_NodeId *methodId, void *methodContext,
+    const UA_NodeId *objectId, void *objectContext,
+    size_t inputSize, const UA_Variant *input,
+    size_t outputSize, UA_Variant *output);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,278 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_stream.c
+  OpcUaStreamServer : data stream records, shot history and the ring buffer
+  distributing them from the stream reader to the consumers
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "libera_stream.h"
+
+void shot_decode(const struct single_pass_data *record, ShotData *shot)
+{
+    shot->va = record->va;
+    shot->vb = record->vb;
+    shot->vc = record->vc;
+    shot->vd = record->vd;
+    shot->pos_x = 1.e-6 * record->x;
+    shot->pos_y = 1.e-6 * record->y;
+    shot->charge = 0.0001 * record->sum;
+    shot->shape_q = 1.e-6 * record->q;
+    shot->trigger_cnt = record->trigger_cnt;
+    shot->bunch_cnt = record->bunch_cnt;
+    shot->status = record->status;
+    shot->time = record->time;
+}
+
+void snapshot_write(ShotSnapshot *snapshot, const ShotData *shot)
+{
+    uint32_t seq = snapshot->sequence;
+    __atomic_store_n(&snapshot->sequence, seq+1, __ATOMIC_RELAXED);
+    // the odd sequence number must be visible before the data changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    snapshot->data = *shot;
+    __atomic_store_n(&snapshot->sequence, seq+2, __ATOMIC_RELEASE);
+}
+
+uint32_t snapshot_read(const ShotSnapshot *snapshot, ShotData *shot)
+{
+    uint32_t seq1, seq2;
+    do {
+        seq1 = __atomic_load_n(&snapshot->sequence, __ATOMIC_ACQUIRE);
+        *shot = snapshot->data;
+        // make sure the copy is complete before checking the sequence again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq2 = __atomic_load_n(&snapshot->sequence, __ATOMIC_RELAXED);
+    } while ((seq1 & 1) || (seq1 != seq2));
+    return seq1;
+}
+
+uint32_t snapshot_sequence(const ShotSnapshot *snapshot)
+{
+    return __atomic_load_n(&snapshot->sequence, __ATOMIC_ACQUIRE);
+}
+
+const size_t history_elemsize[HISTORY_SIGNALS] = {
+    [HISTORY_VA] = sizeof(int32_t),
+    [HISTORY_VB] = sizeof(int32_t),
+    [HISTORY_VC] = sizeof(int32_t),
+    [HISTORY_VD] = sizeof(int32_t),
+    [HISTORY_CHARGE] = sizeof(double),
+    [HISTORY_POSX] = sizeof(double),
+    [HISTORY_POSY] = sizeof(double),
+    [HISTORY_SHAPEQ] = sizeof(double),
+    [HISTORY_TRIGGERCNT] = sizeof(uint32_t),
+    [HISTORY_TIME] = sizeof(int64_t)
+};
+
+int history_init(ShotHistory *history, uint32_t depth)
+{
+    if ((depth == 0) || (depth > HISTORY_MAX_DEPTH))
+        return -1;
+    history->depth = depth;
+    history->size = 2*depth;
+    history->count = 0;
+    for (int i=0; i<HISTORY_SIGNALS; i++)
+        history->data[i] = NULL;
+    for (int i=0; i<HISTORY_SIGNALS; i++)
+        if (posix_memalign(&history->data[i], CACHELINE, (size_t)history->size * history_elemsize[i]) != 0)
+        {
+            history_free(history);
+            return -2;
+        }
+    return 0;
+}
+
+void history_free(ShotHistory *history)
+{
+    for (int i=0; i<HISTORY_SIGNALS; i++)
+    {
+        free(history->data[i]);
+        history->data[i] = NULL;
+    }
+}
+
+void history_write(ShotHistory *history, const ShotData *shot)
+{
+    uint64_t seq = history->count;
+    uint32_t slot = (uint32_t)(seq % history->size);
+    // the slot must not be modified before the previous count update is visible
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ((int32_t *)history->data[HISTORY_VA])[slot] = shot->va;
+    ((int32_t *)history->data[HISTORY_VB])[slot] = shot->vb;
+    ((int32_t *)history->data[HISTORY_VC])[slot] = shot->vc;
+    ((int32_t *)history->data[HISTORY_VD])[slot] = shot->vd;
+    ((double *)history->data[HISTORY_CHARGE])[slot] = shot->charge;
+    ((double *)history->data[HISTORY_POSX])[slot] = shot->pos_x;
+    ((double *)history->data[HISTORY_POSY])[slot] = shot->pos_y;
+    ((double *)history->data[HISTORY_SHAPEQ])[slot] = shot->shape_q;
+    ((uint32_t *)history->data[HISTORY_TRIGGERCNT])[slot] = shot->trigger_cnt;
+    ((int64_t *)history->data[HISTORY_TIME])[slot] = shot->timestamp;
+    __atomic_store_n(&history->count, seq+1, __ATOMIC_RELEASE);
+}
+
+uint32_t history_length(const ShotHistory *history)
+{
+    uint64_t count = __atomic_load_n(&history->count, __ATOMIC_ACQUIRE);
+    return (count < history->depth) ? (uint32_t)count : history->depth;
+}
+
+uint32_t history_read(const ShotHistory *history, int signal, uint32_t first, uint32_t n, void *dst)
+{
+    size_t elemsize = history_elemsize[signal];
+    const char *src = (const char *)history->data[signal];
+    uint64_t count, seq;
+    do {
+        count = __atomic_load_n(&history->count, __ATOMIC_ACQUIRE);
+        uint32_t length = (count < history->depth) ? (uint32_t)count : history->depth;
+        if (first >= length)
+            return 0;
+        if (n > length - first)
+            n = length - first;
+        // sequence number of the first shot to be copied
+        seq = count - length + first;
+        uint32_t slot = (uint32_t)(seq % history->size);
+        uint32_t part = history->size - slot;
+        if (part > n) part = n;
+        memcpy(dst, src + (size_t)slot * elemsize, (size_t)part * elemsize);
+        if (part < n)
+            memcpy((char *)dst + (size_t)part * elemsize, src, (size_t)(n - part) * elemsize);
+        // make sure the copy is complete before checking the count again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        count = __atomic_load_n(&history->count, __ATOMIC_RELAXED);
+        // the writer may have overwritten the oldest copied slot meanwhile
+    } while (seq + history->size <= count);
+    return n;
+}
+
+int ring_init(StreamRing *ring, uint32_t size)
+{
+    void *mem;
+    if ((size == 0) || ((size & (size-1)) != 0))
+        return -1;
+    if (posix_memalign(&mem, CACHELINE, (size_t)size * sizeof(struct single_pass_data)) != 0)
+        return -2;
+    memset(mem, 0, (size_t)size * sizeof(struct single_pass_data));
+    ring->slots = (struct single_pass_data *)mem;
+    ring->size = size;
+    ring->mask = size-1;
+    ring->head = 0;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+    return 0;
+}
+
+void ring_free(StreamRing *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+    pthread_cond_destroy(&ring->cond);
+    pthread_mutex_destroy(&ring->lock);
+}
+
+void ring_write(StreamRing *ring, const struct single_pass_data *record)
+{
+    uint64_t seq = ring->head;
+    // the slot must not be modified before the previous head update is visible
+    // otherwise a consumer could not detect that it has been overwritten
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring->slots[seq & ring->mask] = *record;
+    __atomic_store_n(&ring->head, seq+1, __ATOMIC_RELEASE);
+}
+
+void ring_notify(StreamRing *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void ring_reader_init(RingReader *reader, StreamRing *ring)
+{
+    reader->ring = ring;
+    reader->cursor = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    reader->records = 0;
+    reader->overruns = 0;
+}
+
+int ring_read(RingReader *reader, struct single_pass_data *record)
+{
+    StreamRing *ring = reader->ring;
+    while (1)
+    {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (reader->cursor == head)
+            return 0;
+        // skip the records which have already been overwritten
+        if (head - reader->cursor > ring->size)
+        {
+            counter_add(&reader->overruns, head - reader->cursor - ring->size);
+            reader->cursor = head - ring->size;
+        }
+        *record = ring->slots[reader->cursor & ring->mask];
+        // make sure the copy is complete before checking the head again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        // the producer may have overwritten the slot while we were copying
+        if (head - reader->cursor >= ring->size)
+        {
+            counter_add(&reader->overruns, 1);
+            reader->cursor++;
+            continue;
+        }
+        reader->cursor++;
+        counter_add(&reader->records, 1);
+        return 1;
+    }
+}
+
+int ring_wait(RingReader *reader, int timeout_ms)
+{
+    StreamRing *ring = reader->ring;
+    struct timespec deadline;
+    int available;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&ring->lock);
+    while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == reader->cursor)
+        if (pthread_cond_timedwait(&ring->cond, &ring->lock, &deadline) == ETIMEDOUT)
+            break;
+    available = (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != reader->cursor);
+    pthread_mutex_unlock(&ring->lock);
+    return available;
+}
@@ -0,0 +1,281 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_stream.h
+  OpcUaStreamServer : data stream records, shot history and the ring buffer
+  distributing them from the stream reader to the consumers
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERASTREAM_H
+#define LIBERASTREAM_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************/
+/* definitions for the data stream */
+/***********************************/
+
+#define BLOCKSIZE 64
+
+// status of the source stream
+#define STREAM_SOURCE_CLOSED -1
+#define STREAM_SOURCE_GOOD 0
+#define STREAM_SOURCE_STALLED 1
+#define STREAM_SOURCE_ERROR 2
+
+#define CACHELINE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHELINE)))
+
+// the data structure sent by the Libera instrument
+struct single_pass_data {
+   int32_t va;
+   int32_t vb;
+   int32_t vc;
+   int32_t vd;
+   int32_t sum;
+   int32_t q;
+   int32_t x;
+   int32_t y;
+   uint32_t trigger_cnt;
+   uint32_t bunch_cnt;
+   uint32_t status;
+   uint32_t mode;
+   int32_t R2;
+   int32_t R3;
+   uint64_t time;
+};
+
+/***********************************/
+/* decoded shot data               */
+/***********************************/
+/*
+    The values of the latest shot are published as one snapshot
+    protected by a sequence lock. The single writer increments the sequence
+    number before and after updating the data, so it is odd while the update
+    is in progress. A reader copies the data and retries if the sequence
+    number was odd or has changed meanwhile. So the readers always get all
+    values from the same shot and the writer never waits for a reader.
+*/
+
+// the decoded values of one shot
+typedef struct {
+    int32_t va;
+    int32_t vb;
+    int32_t vc;
+    int32_t vd;
+    double charge;          // bunch charge in pC
+    double pos_x;           // position X in mm
+    double pos_y;           // position Y in mm
+    double shape_q;         // shape parameter q
+    uint32_t trigger_cnt;
+    uint32_t bunch_cnt;
+    uint32_t status;
+    uint64_t time;          // hardware time stamp of the record
+    int64_t timestamp;      // hardware time stamp as UA_DateTime (100 ns since 1601)
+    int64_t received;       // receive time as UA_DateTime
+} ShotData;
+
+typedef struct {
+    volatile uint32_t sequence;
+    ShotData data;
+} ShotSnapshot;
+
+// convert a raw record into the shot values
+void shot_decode(const struct single_pass_data *record, ShotData *shot);
+
+// publish a new shot (single writer only)
+void snapshot_write(ShotSnapshot *snapshot, const ShotData *shot);
+
+// get a consistent copy of the latest shot
+// returns the sequence number of the copy
+uint32_t snapshot_read(const ShotSnapshot *snapshot, ShotData *shot);
+
+// the current sequence number, it changes whenever a new shot is published
+uint32_t snapshot_sequence(const ShotSnapshot *snapshot);
+
+/***********************************/
+/* shot history                    */
+/***********************************/
+/*
+    The history holds the values of the last shots, stored as one
+    array per signal (structure-of-arrays) so that any range of
+    one signal can be copied with at most two memcpy() calls.
+
+    There is a single writer (the value stage). The number of shots written
+    is incremented after a shot has been stored. A reader copies the range
+    and checks afterwards that none of the copied slots has been overwritten
+    in the meantime, otherwise it retries. The storage has twice the
+    visible depth, so the writer can proceed by up to depth shots
+    while a reader is copying.
+*/
+
+// default and maximum number of shots held in the history
+#define HISTORY_DEPTH 4096
+#define HISTORY_MAX_DEPTH 65536
+
+// the signals held in the history
+enum {
+    HISTORY_VA,
+    HISTORY_VB,
+    HISTORY_VC,
+    HISTORY_VD,
+    HISTORY_CHARGE,
+    HISTORY_POSX,
+    HISTORY_POSY,
+    HISTORY_SHAPEQ,
+    HISTORY_TRIGGERCNT,
+    HISTORY_TIME,
+    HISTORY_SIGNALS
+};
+
+// size of the elements of the signal arrays in bytes
+extern const size_t history_elemsize[HISTORY_SIGNALS];
+
+typedef struct {
+    // number of shots written so far, written by the writer only
+    volatile uint64_t count CACHE_ALIGNED;
+    // the rest is constant after initialization
+    uint32_t depth CACHE_ALIGNED;
+    uint32_t size;
+    void *data[HISTORY_SIGNALS];
+} ShotHistory;
+
+// allocate the history for depth shots
+// returns 0 on success
+int history_init(ShotHistory *history, uint32_t depth);
+
+// release the history memory
+void history_free(ShotHistory *history);
+
+// append one shot to the history (single writer only)
+void history_write(ShotHistory *history, const ShotData *shot);
+
+// number of shots currently available (at most depth)
+uint32_t history_length(const ShotHistory *history);
+
+// copy up to n values of one signal into dst, starting with index first
+// index 0 is the oldest shot held in the history, the newest is history_length()-1
+// returns the number of values copied, which is less than n if the range exceeds the history
+uint32_t history_read(const ShotHistory *history, int signal, uint32_t first, uint32_t n, void *dst);
+
+/***********************************/
+/* statistics counters             */
+/***********************************/
+/*
+    The statistics of the data stream are counted by the thread handling
+    the data and read by the server thread. Every counter has a single writer,
+    so an atomic store of the incremented value is sufficient. It makes sure
+    that the 64-bit counters cannot be read half-updated on the 32-bit ARM.
+*/
+
+// add n to a counter (only called by the single writer)
+static inline void counter_add(uint64_t *counter, uint64_t n)
+{
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+// read a counter from any thread
+static inline uint64_t counter_get(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/***********************************/
+/* ring buffer                     */
+/***********************************/
+/*
+    The ring buffer has a single producer (the stream reader) and
+    any number of consumers. Every consumer has its own RingReader
+    holding its read position. The producer never waits for the consumers.
+    A consumer falling behind by more than the ring size loses the
+    oldest records, which are counted as overruns.
+
+    Records are numbered by a 64-bit sequence number which never wraps.
+    The slot of a record is its sequence number modulo the ring size
+    (which has to be a power of two).
+*/
+
+// default and maximum size of the ring buffer in records
+#define RING_RECORDS 4096
+#define RING_MAX_RECORDS 1048576
+
+typedef struct {
+    // sequence number of the next record to be written
+    // written by the producer only
+    volatile uint64_t head CACHE_ALIGNED;
+    // the rest is constant after initialization
+    struct single_pass_data *slots CACHE_ALIGNED;
+    uint32_t size;
+    uint32_t mask;
+    // used to wake up sleeping consumers
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} StreamRing;
+
+typedef struct {
+    StreamRing *ring;
+    // sequence number of the next record to be read
+    uint64_t cursor CACHE_ALIGNED;
+    // number of records consumed
+    uint64_t records;
+    // number of records lost because the consumer fell behind
+    uint64_t overruns;
+} RingReader;
+
+// allocate the ring buffer, size must be a power of two
+// returns 0 on success
+int ring_init(StreamRing *ring, uint32_t size);
+
+// release the ring buffer memory
+void ring_free(StreamRing *ring);
+
+// append one record to the ring (producer only)
+void ring_write(StreamRing *ring, const struct single_pass_data *record);
+
+// wake up all consumers waiting for data
+// the producer calls this once after a batch of records has been written
+void ring_notify(StreamRing *ring);
+
+// attach a reader to the ring, it will see only records written from now on
+void ring_reader_init(RingReader *reader, StreamRing *ring);
+
+// copy the next record into *record
+// returns 1 if a record was read, 0 if no new data is available
+int ring_read(RingReader *reader, struct single_pass_data *record);
+
+// wait until new data is available for the reader or the timeout [ms] expires
+// returns 1 if data is available
+int ring_wait(RingReader *reader, int timeout_ms);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,479 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_udp.c
+  OpcUaStreamServer : UDP output data stream
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/udp.h>	 // declarations for udp header
+#include <netinet/ip.h>		 // declarations for ip header
+#include <arpa/inet.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CSUM_NEON
+#elif defined(CSUM_NEON_MODEL)
+#include "libera_neon_model.h"
+#define CSUM_NEON
+#endif
+
+#include "libera_udp.h"
+
+// buffer for a complete raw packet including IP and UDP headers
+#define BUFFERSIZE 1536
+
+// header structure needed for checksum calculation
+struct pseudo_header
+{
+    u_int32_t source_address;
+    u_int32_t dest_address;
+    u_int8_t placeholder;
+    u_int8_t protocol;
+    u_int16_t udp_length;
+};
+ 
+// data structures for the UDP output stream
+static int udp_socket = -1;
+static UdpConfig udp_config;
+uint32_t udp_counter;		           // counter for transmitted UDP packets
+UdpStatistics udp_stats;               // counters since the start of the server
+static struct sockaddr_in udp_server;
+static struct in_addr udp_source;	   // IP address of this BPM
+static struct in_addr udp_target;	   // IP address of the server the data is sent to
+
+// data structures for the assembly of outgoing raw UDP packets
+// the IP and UDP headers are prepared once when the stream is opened,
+// the payload is assembled in place right behind them
+static char udp_buffer[BUFFERSIZE] __attribute__((aligned(4)));	    // UDP packet buffer
+static struct iphdr *udp_iph = (struct iphdr *) udp_buffer;
+static struct udphdr *udp_udph = (struct udphdr *) (udp_buffer + sizeof(struct iphdr));
+static char *udp_rawdata = udp_buffer + sizeof(struct iphdr) + sizeof(struct udphdr);
+static uint32_t udp_ip_sum;            // checksum sum of the IP header template
+static uint32_t udp_header_sum;        // checksum sum of the constant UDP pseudo header fields
+
+// payload of the packets under assembly
+// in datagram mode all complete packets are queued until they are sent
+// the packet presently being filled is the one following the queued ones
+static char udp_payload[UDP_MAX_BATCH][UDP_MAX_PAYLOAD];
+static size_t udp_length[UDP_MAX_BATCH];
+static int udp_queued = 0;             // number of complete packets waiting
+static int udp_fill = 0;               // number of records in the current packet
+static uint32_t udp_sequence = 0;      // sequence number of the next packet
+static struct timespec udp_packet_start;    // time the current packet was started
+static uint64_t udp_first_time[UDP_MAX_BATCH];  // time stamp of the first record of the packets
+
+// message headers for sendmmsg()
+static struct iovec udp_iov[UDP_MAX_BATCH];
+static struct mmsghdr udp_msgs[UDP_MAX_BATCH];
+
+// add the 16-bit words of a buffer to a checksum sum
+// the result is not yet folded to 16 bits
+/*
+    The ones-complement sum does not depend on the order of the additions
+    and the carries can be folded back at the very end. With NEON the words are
+    summed 16 at a time by pairwise widening adds into four 32-bit lanes,
+    which are widened into 64 bits before they could overflow.
+    The scalar loop handles the remaining bytes and builds without NEON.
+    csumtest checks the NEON path against the scalar loop.
+*/
+uint32_t csum_partial(const unsigned short *ptr, int nbytes, uint32_t sum)
+{
+    uint64_t acc = sum;
+    unsigned short oddbyte;
+#ifdef CSUM_NEON
+    if (nbytes >= 32) {
+        uint64x2_t acc64 = vdupq_n_u64(0);
+        while (nbytes >= 32) {
+            // every block adds at most 4*0xffff to a lane
+            int blocks = nbytes / 32;
+            if (blocks > 4096) blocks = 4096;
+            uint32x4_t acc32 = vdupq_n_u32(0);
+            for (int i=0; i<blocks; i++) {
+                acc32 = vpadalq_u16(acc32, vld1q_u16(ptr));
+                acc32 = vpadalq_u16(acc32, vld1q_u16(ptr+8));
+                ptr += 16;
+            }
+            nbytes -= blocks * 32;
+            acc64 = vpadalq_u32(acc64, acc32);
+        }
+        acc += vgetq_lane_u64(acc64, 0);
+        acc += vgetq_lane_u64(acc64, 1);
+        acc = (acc>>32)+(acc & 0xffffffff);
+    }
+#endif
+    while(nbytes>1) {
+        acc+=*ptr++;
+        nbytes-=2;
+    }
+    if(nbytes==1) {
+        oddbyte=0;
+        *((unsigned char*)&oddbyte)=*(unsigned char*)ptr;
+        acc+=oddbyte;
+    }
+    acc = (acc>>32)+(acc & 0xffffffff);
+    acc = (acc>>32)+(acc & 0xffffffff);
+    return (uint32_t)acc;
+}
+
+// fold a checksum sum into 16 bits with end-around carry
+uint16_t csum_fold(uint32_t sum)
+{
+    sum = (sum>>16)+(sum & 0xffff);
+    sum = sum + (sum>>16);
+    return (uint16_t)sum;
+}
+
+// generic checksum calculation function
+unsigned short csum(unsigned short *ptr, int nbytes)
+{
+    return (unsigned short)~csum_fold(csum_partial(ptr, nbytes, 0));
+}
+
+// prepare the IP and UDP headers of the raw packets
+/*
+    Between the packets only the IP id, the IP and UDP lengths and the payload change.
+    The checksum sums of all constant header fields are computed once here.
+    The IP checksum is then updated incrementally (RFC 1624) from the id and length,
+    the UDP checksum needs only to add the length and the payload to the prepared sum.
+    The template has id and lengths set to zero, so their contributions just add on.
+*/
+static void buildTemplate()
+{
+    struct pseudo_header psh;
+    memset(udp_buffer, 0, sizeof(struct iphdr) + sizeof(struct udphdr));
+    udp_iph->ihl = 5;
+    udp_iph->version = 4;
+    udp_iph->tos = 0;
+    udp_iph->tot_len = 0;
+    udp_iph->id = 0;
+    udp_iph->frag_off = 0;
+    udp_iph->ttl = 255;
+    udp_iph->protocol = IPPROTO_UDP;
+    udp_iph->check = 0;
+    udp_iph->saddr = udp_source.s_addr;      // spoof the source IP address
+    udp_iph->daddr = udp_target.s_addr;      // receiver IP address
+    udp_ip_sum = csum_partial((unsigned short *) udp_iph, sizeof(struct iphdr), 0);
+    udp_udph->source = htons(udp_config.source_port);
+    udp_udph->dest = htons(udp_config.target_port);
+    udp_udph->len = 0;
+    udp_udph->check = 0;
+    psh.source_address = udp_source.s_addr;
+    psh.dest_address = udp_target.s_addr;
+    psh.placeholder = 0;
+    psh.protocol = IPPROTO_UDP;
+    psh.udp_length = 0;
+    udp_header_sum = csum_partial((unsigned short *) &psh, sizeof(struct pseudo_header), 0);
+    udp_header_sum = csum_partial((unsigned short *) udp_udph, sizeof(struct udphdr), udp_header_sum);
+}
+
+// create a raw socket of type IPPROTO
+static int openRaw()
+{
+    udp_socket = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+    if(udp_socket == -1)
+    {
+        printf("OpcUaServer : Failed to create raw socket. Maybe not permitted?\n");
+        return UDP_STREAM_NO_SOCKET;
+    };
+    buildTemplate();
+    return UDP_STREAM_GOOD;
+}
+
+// create a datagram socket bound to the source port and connected to the target
+static int openDatagram()
+{
+    struct sockaddr_in local;
+    int on = 1;
+    udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if(udp_socket == -1)
+    {
+        printf("OpcUaServer : Failed to create datagram socket\n");
+        return UDP_STREAM_NO_SOCKET;
+    };
+    setsockopt(udp_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = udp_source.s_addr;
+    local.sin_port = htons(udp_config.source_port);
+    if (bind(udp_socket, (struct sockaddr *)&local, sizeof(local)) == -1)
+    {
+        // the configured source IP may not be an address of this host
+        printf("OpcUaServer : cannot bind to source IP %s, using any address\n", inet_ntoa(udp_source));
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(udp_socket, (struct sockaddr *)&local, sizeof(local)) == -1)
+        {
+            perror("OpcUaServer : bind() UDP source port");
+            close(udp_socket);
+            udp_socket = -1;
+            return UDP_STREAM_NO_SOCKET;
+        }
+    }
+    // a connected socket saves the route lookup for every packet
+    if (connect(udp_socket, (struct sockaddr *)&udp_server, sizeof(udp_server)) == -1)
+    {
+        perror("OpcUaServer : connect() UDP target");
+        close(udp_socket);
+        udp_socket = -1;
+        return UDP_STREAM_NO_SOCKET;
+    }
+    // every message of a batch points to its own packet buffer
+    memset(udp_msgs, 0, sizeof(udp_msgs));
+    for (int i=0; i<UDP_MAX_BATCH; i++)
+    {
+        udp_iov[i].iov_base = udp_payload[i];
+        udp_msgs[i].msg_hdr.msg_iov = &udp_iov[i];
+        udp_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return UDP_STREAM_GOOD;
+}
+
+int udp_open(const UdpConfig *config)
+{
+    int err;
+    printf("OpcUaServer : open UDP data stream\n");
+    udp_counter = 0;
+    udp_sequence = 0;
+    udp_queued = 0;
+    udp_fill = 0;
+    udp_config = *config;
+    if (udp_config.batch < 1) udp_config.batch = 1;
+    if (udp_config.batch > UDP_MAX_BATCH) udp_config.batch = UDP_MAX_BATCH;
+    if (udp_config.records < 1) udp_config.records = 1;
+    if (udp_config.records > UDP_MAX_RECORDS) udp_config.records = UDP_MAX_RECORDS;
+    // set addresses for the UDP output stream
+    udp_source.s_addr = udp_config.source_ip;
+    udp_target.s_addr = udp_config.target_ip;
+    // compile the server address
+    memset(&udp_server, 0, sizeof(udp_server));
+    udp_server.sin_family = AF_INET;
+    udp_server.sin_addr.s_addr = udp_target.s_addr;
+    udp_server.sin_port = htons(udp_config.target_port);
+    if (udp_config.mode == UDP_MODE_DATAGRAM)
+        err = openDatagram();
+    else
+        err = openRaw();
+    printf("OpcUaServer : UDP source IP %s (%d) port %d\n",inet_ntoa(udp_source), udp_source.s_addr, udp_config.source_port);
+    printf("OpcUaServer : sending data to IP: %s (%d) port %d\n",inet_ntoa(udp_target), udp_target.s_addr, udp_config.target_port);
+    if (udp_config.mode == UDP_MODE_DATAGRAM)
+        printf("OpcUaServer : datagram mode, up to %d packets per sendmmsg()\n", udp_config.batch);
+    else
+        printf("OpcUaServer : raw socket mode\n");
+    if (udp_config.records > 1)
+        printf("OpcUaServer : %d records per packet, max. latency %d ms\n", udp_config.records, udp_config.latency_ms);
+    return err;
+}
+
+int udp_close()
+{
+    printf("OpcUaServer : close UDP data stream\n");
+    if (udp_socket == -1)
+        return UDP_STREAM_CLOSED;
+    // send whatever is left over
+    udp_config.latency_ms = 0;
+    udp_flush();
+    int status = close(udp_socket);
+    if (status==-1) printf("OpcUaServer : error closing the UDPsocket\n");
+    udp_socket = -1;
+    return UDP_STREAM_CLOSED;
+}
+
+// record the latency of n packets which have been sent
+static void udp_sent(int n)
+{
+    if (udp_config.latency == NULL)
+        return;
+    uint64_t now = latency_now();
+    for (int i=0; i<n; i++)
+        latency_add(udp_config.latency, udp_first_time[i], now);
+}
+
+// a send call failed only because the socket buffer is full
+// the packets are dropped but the stream remains open
+static int sendBlocked(int err)
+{
+    return (err == EAGAIN) || (err == EWOULDBLOCK) || (err == ENOBUFS);
+}
+
+// send the payload assembled in the raw packet buffer
+static int sendRaw(size_t length)
+{
+    size_t total = sizeof(struct iphdr) + sizeof(struct udphdr) + length;
+    uint16_t udp_len = htons(sizeof(struct udphdr) + length);
+    udp_counter++;
+    // complete the IP Header
+    udp_iph->tot_len = htons(total);
+    udp_iph->id = udp_counter;               // Id of this packet
+    udp_iph->check = ~csum_fold(udp_ip_sum + udp_iph->id + udp_iph->tot_len);
+    // complete the UDP header
+    // the length appears twice, in the pseudo header and in the UDP header
+    udp_udph->len = udp_len;
+    uint32_t sum = csum_partial((unsigned short *) udp_rawdata, length, udp_header_sum + 2*(uint32_t)udp_len);
+    udp_udph->check = ~csum_fold(sum);
+    // a computed checksum of zero is transmitted as all ones
+    if (udp_udph->check == 0) udp_udph->check = 0xffff;
+    //Send the packet
+    if (sendto (udp_socket, udp_buffer, total,  0, (struct sockaddr *) &udp_server, sizeof (udp_server)) < 0)
+    {
+        if (sendBlocked(errno))
+        {
+            counter_add(&udp_stats.blocked, 1);
+            return UDP_STREAM_GOOD;
+        }
+        counter_add(&udp_stats.errors, 1);
+        return UDP_STREAM_SEND_ERROR;
+    }
+    counter_add(&udp_stats.packets, 1);
+    counter_add(&udp_stats.bytes, total);
+    udp_sent(1);
+    return UDP_STREAM_GOOD;
+}
+
+// send all queued packets in datagram mode
+static int sendQueue()
+{
+    int sent = 0;
+    uint64_t bytes = 0;
+    for (int i=0; i<udp_queued; i++)
+        udp_iov[i].iov_len = udp_length[i];
+    while (sent < udp_queued)
+    {
+        int n = sendmmsg(udp_socket, &udp_msgs[sent], udp_queued - sent, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            // the rest of the batch is dropped
+            if (sendBlocked(errno))
+            {
+                counter_add(&udp_stats.blocked, udp_queued - sent);
+                break;
+            }
+            counter_add(&udp_stats.errors, 1);
+            udp_queued = 0;
+            return UDP_STREAM_SEND_ERROR;
+        }
+        for (int i=sent; i<sent+n; i++)
+            bytes += sizeof(struct iphdr) + sizeof(struct udphdr) + udp_length[i];
+        sent += n;
+    }
+    udp_counter += sent;
+    counter_add(&udp_stats.packets, sent);
+    counter_add(&udp_stats.bytes, bytes);
+    udp_sent(sent);
+    // a partially filled packet moves to the front of the queue
+    if ((udp_fill > 0) && (udp_queued > 0))
+    {
+        memcpy(udp_payload[0], udp_payload[udp_queued],
+            sizeof(struct stream_packet_header) + udp_fill * BLOCKSIZE);
+        udp_first_time[0] = udp_first_time[udp_queued];
+    }
+    udp_queued = 0;
+    return UDP_STREAM_GOOD;
+}
+
+// the buffer for the payload of the current packet
+// in raw mode the payload is assembled right behind the prepared headers
+static char *currentPacket()
+{
+    if (udp_config.mode != UDP_MODE_DATAGRAM)
+        return udp_rawdata;
+    return udp_payload[udp_queued];
+}
+
+// the current packet is complete, send or queue it
+static int completePacket()
+{
+    char *packet = currentPacket();
+    if (udp_config.records > 1)
+    {
+        struct stream_packet_header *header = (struct stream_packet_header *)packet;
+        header->sequence = udp_sequence;
+        header->count = udp_fill;
+        header->size = BLOCKSIZE;
+        udp_length[udp_queued] = sizeof(struct stream_packet_header) + udp_fill * BLOCKSIZE;
+    }
+    else
+        udp_length[udp_queued] = BLOCKSIZE;
+    udp_sequence++;
+    udp_fill = 0;
+    if (udp_config.mode != UDP_MODE_DATAGRAM)
+        return sendRaw(udp_length[udp_queued]);
+    udp_queued++;
+    if (udp_queued >= udp_config.batch)
+        return sendQueue();
+    return UDP_STREAM_GOOD;
+}
+
+int udp_send(const struct single_pass_data *record)
+{
+    char *packet = currentPacket();
+    if (udp_config.records == 1)
+    {
+        memcpy(packet, record, BLOCKSIZE);
+        udp_first_time[udp_queued] = record->time;
+        udp_fill = 1;
+        return completePacket();
+    }
+    struct stream_packet_header *header = (struct stream_packet_header *)packet;
+    if (udp_fill == 0)
+    {
+        udp_first_time[udp_queued] = record->time;
+        header->first_trigger = record->trigger_cnt;
+        clock_gettime(CLOCK_MONOTONIC, &udp_packet_start);
+    }
+    header->last_trigger = record->trigger_cnt;
+    memcpy(packet + sizeof(struct stream_packet_header) + udp_fill * BLOCKSIZE, record, BLOCKSIZE);
+    udp_fill++;
+    if (udp_fill >= udp_config.records)
+        return completePacket();
+    return UDP_STREAM_GOOD;
+}
+
+int udp_flush()
+{
+    int err = UDP_STREAM_GOOD;
+    // close a partially filled packet when it has waited long enough
+    if (udp_fill > 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long age_ms = (now.tv_sec - udp_packet_start.tv_sec) * 1000L +
+            (now.tv_nsec - udp_packet_start.tv_nsec) / 1000000L;
+        if (age_ms >= udp_config.latency_ms)
+            err = completePacket();
+    }
+    if ((udp_config.mode == UDP_MODE_DATAGRAM) && (udp_queued > 0) && (err == UDP_STREAM_GOOD))
+        err = sendQueue();
+    return err;
+}
@@ -0,0 +1,140 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file libera_udp.h
+  OpcUaStreamServer : UDP output data stream
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+ */
+
+#ifndef LIBERAUDP_H
+#define LIBERAUDP_H
+
+#include <stdint.h>
+
+#include "libera_stream.h"
+#include "libera_latency.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// error codes
+#define UDP_STREAM_CLOSED -1
+#define UDP_STREAM_NO_SOCKET -2
+#define UDP_STREAM_SEND_ERROR -3
+#define UDP_STREAM_GOOD 1
+
+// transport modes of the UDP stream
+// raw : IP and UDP headers are assembled by ourselves, allows to spoof the source IP
+// datagram : kernel socket bound to the source port, the kernel/NIC computes headers
+//            and checksums, queued packets are sent in batches with sendmmsg()
+#define UDP_MODE_RAW 0
+#define UDP_MODE_DATAGRAM 1
+
+// default and maximum number of packets sent with one sendmmsg() call
+#define UDP_BATCH 16
+#define UDP_MAX_BATCH 64
+
+// maximum UDP payload fitting into an ethernet frame (1500 - 20 - 8)
+#define UDP_MAX_PAYLOAD 1472
+
+/*
+    Several records can be packed into one UDP packet. Such a packet starts with
+    the stream_packet_header followed by count records. All fields are in the
+    byte order of the device (little endian) like the records themselves.
+    With one record per packet (the default) the packet contains just the
+    record without any header, as it was always sent.
+*/
+struct stream_packet_header {
+    uint32_t sequence;          // packet counter
+    uint16_t count;             // number of records in the packet
+    uint16_t size;              // size of one record in bytes
+    uint32_t first_trigger;     // trigger_cnt of the first record
+    uint32_t last_trigger;      // trigger_cnt of the last record
+};
+
+// maximum number of records packed into one packet
+#define UDP_MAX_RECORDS ((int)((UDP_MAX_PAYLOAD - sizeof(struct stream_packet_header)) / BLOCKSIZE))
+
+// default and maximum time [ms] a record waits for the packet to be filled
+#define UDP_LATENCY 10
+#define UDP_MAX_LATENCY 1000
+
+// settings of the UDP output stream
+typedef struct {
+    int mode;                   // UDP_MODE_RAW or UDP_MODE_DATAGRAM
+    int batch;                  // packets per sendmmsg() call (datagram mode)
+    int records;                // records per packet
+    int latency_ms;             // maximum delay of a partially filled packet
+    uint32_t source_ip;         // network byte order
+    uint32_t source_port;       // host byte order
+    uint32_t target_ip;         // network byte order
+    uint32_t target_port;       // host byte order
+    LatencyHistogram *latency;  // optional, the latency of the first record of every packet sent
+} UdpConfig;
+
+// counter for transmitted UDP packets
+extern uint32_t udp_counter;
+
+// statistics of the UDP output stream since the start of the server
+// written only by the thread sending the stream, read them with counter_get()
+typedef struct {
+    uint64_t packets;           // packets sent
+    uint64_t bytes;             // bytes sent on the wire (IP datagrams including the IP and UDP headers)
+    uint64_t errors;            // failed send calls, the stream is closed after them
+    uint64_t blocked;           // packets dropped because the socket buffer was full (EAGAIN, ENOBUFS)
+} UdpStatistics;
+extern UdpStatistics udp_stats;
+
+// open the output stream
+int udp_open(const UdpConfig *config);
+
+// close the output stream
+int udp_close();
+
+// send one data record
+// the record is added to the current packet, complete packets are sent
+// right away in raw mode and queued until the batch is full in datagram mode
+// returns UDP_STREAM_GOOD or an error code
+int udp_send(const struct single_pass_data *record);
+
+// send all queued packets and a partially filled packet
+// which has been waiting for longer than the latency limit
+// returns UDP_STREAM_GOOD or an error code
+int udp_flush();
+
+// generic checksum calculation function
+unsigned short csum(unsigned short *ptr, int nbytes);
+
+// add the 16-bit words of a buffer to a checksum sum (not folded)
+uint32_t csum_partial(const unsigned short *ptr, int nbytes, uint32_t sum);
+
+// fold a checksum sum into 16 bits with end-around carry
+uint16_t csum_fold(uint32_t sum);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,355 @@
+/*
+MIT License
+
+Copyright (c) 2017 Ulf Lehnert, Helmholtz-Center Dresden-Rossendorf
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file streamgen.c
+  OpcUaStreamServer : synthetic source of Libera data stream records
+  @author U. Lehnert, Helmholtz-Zentrum Dresden-Rossendorf
+
+  This program feeds the server with records in the format of /dev/libera.strm0,
+  so the data paths can be tested and benchmarked on any Linux host.
+  The server reads them when the device property of <stream><input> is set to
+  the FIFO, file or unix socket written by this program.
+
+  The records are either synthesized or replayed from a file captured on a device
+  (e.g. with dd if=/dev/libera.strm0 of=capture.bin bs=64 count=100000).
+
+  usage: streamgen [options] output
+    output       file or FIFO to write, - for stdout
+    -u           serve the records on a unix socket at the output path
+    -r rate      trigger rate [Hz] (default 1000), 0 for as fast as possible
+    -n count     number of records, 0 (default) for an infinite stream
+    -b burst     number of records written together (default 1)
+    -x pos       mean horizontal position [mm] (default 0)
+    -y pos       mean vertical position [mm] (default 0)
+    -s sigma     RMS position noise [mm] (default 0.01)
+    -a sum       mean sum of the button amplitudes (default 100000)
+    -A sigma     RMS relative noise of the sum (default 0.01)
+    -g prob      probability of a gap in the trigger counter per record (default 0)
+    -G max       maximum number of missing triggers of a gap (default 10)
+    -p file      replay the records of a captured file instead of synthesizing them
+    -t factor    replay speed relative to the recorded time stamps (default 1),
+                 0 for as fast as possible, ignored without -p
+    -T           replace the time stamps of replayed records by the current time
+    -l           replay the file in an endless loop
+ */
+
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "libera_stream.h"
+
+// distance of the electrodes scaling the position to the difference over sum [mm]
+#define BUTTON_K 10.0
+
+// the largest burst of records written at once
+#define MAX_BURST 4096
+
+static double rate = 1000.0;
+static uint64_t count = 0;
+static int burst = 1;
+static double pos_x = 0.0;
+static double pos_y = 0.0;
+static double pos_sigma = 0.01;
+static double sum_mean = 100000.0;
+static double sum_sigma = 0.01;
+static double gap_prob = 0.0;
+static int gap_max = 10;
+static const char *replay_file = NULL;
+static double replay_speed = 1.0;
+static bool restamp = false;
+static bool replay_loop = false;
+static bool unix_socket = false;
+
+static volatile bool running = true;
+
+static void stopHandler(int signal)
+{
+    running = false;
+}
+
+void Die(char *mess)
+{
+    fprintf(stderr, "streamgen : %s\n", mess);
+    exit(1);
+}
+
+static uint64_t now_ns(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// sleep until the given time of the monotonic clock [ns]
+static void sleep_until(uint64_t t)
+{
+    struct timespec ts = { .tv_sec = t / 1000000000, .tv_nsec = t % 1000000000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        if (!running) break;
+}
+
+// normally distributed random number (Box-Muller)
+static double gauss()
+{
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+// synthesize the record of one trigger
+static void synthesize(struct single_pass_data *rec, uint32_t trigger_cnt)
+{
+    double x = pos_x + pos_sigma * gauss();
+    double y = pos_y + pos_sigma * gauss();
+    double sum = sum_mean * (1.0 + sum_sigma * gauss());
+    // buttons A (top right), B (top left), C (bottom left), D (bottom right)
+    double dx = x / BUTTON_K;
+    double dy = y / BUTTON_K;
+    memset(rec, 0, sizeof(struct single_pass_data));
+    rec->va = (int32_t)(0.25 * sum * (1.0 + dx + dy));
+    rec->vb = (int32_t)(0.25 * sum * (1.0 - dx + dy));
+    rec->vc = (int32_t)(0.25 * sum * (1.0 - dx - dy));
+    rec->vd = (int32_t)(0.25 * sum * (1.0 + dx - dy));
+    rec->sum = rec->va + rec->vb + rec->vc + rec->vd;
+    // positions in nm
+    rec->x = (int32_t)(x * 1.e6);
+    rec->y = (int32_t)(y * 1.e6);
+    rec->q = (int32_t)(pos_sigma * gauss() * 1.e6);
+    rec->trigger_cnt = trigger_cnt;
+    rec->bunch_cnt = 1;
+    rec->time = now_ns(CLOCK_REALTIME);
+}
+
+// write all bytes, returns 0 on success
+static int write_all(int fd, const void *buf, size_t size)
+{
+    const char *p = buf;
+    while (size > 0)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// open the output, for a unix socket wait for the server to connect
+static int open_output(const char *path)
+{
+    if (! strcmp(path, "-"))
+        return STDOUT_FILENO;
+    if (! unix_socket)
+        return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        Die("socket path too long");
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((sock < 0) || (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(sock, 1) != 0))
+    {
+        perror("streamgen : socket");
+        return -1;
+    }
+    fprintf(stderr, "streamgen : waiting for a connection on %s\n", path);
+    int fd = accept(sock, NULL, NULL);
+    close(sock);
+    unlink(path);
+    return fd;
+}
+
+// synthesize records at the given rate
+static uint64_t generate(int fd)
+{
+    static struct single_pass_data buffer[MAX_BURST];
+    uint64_t sent = 0;
+    uint32_t trigger_cnt = 0;
+    uint64_t period = (rate > 0.0) ? (uint64_t)(1.e9 / rate) : 0;
+    uint64_t next = now_ns(CLOCK_MONOTONIC);
+    while (running && ((count == 0) || (sent < count)))
+    {
+        int n = burst;
+        if ((count > 0) && (count - sent < (uint64_t)n))
+            n = count - sent;
+        for (int i=0; i<n; i++)
+        {
+            if ((gap_prob > 0.0) && (rand() < gap_prob * RAND_MAX))
+                trigger_cnt += 1 + rand() % gap_max;
+            synthesize(&buffer[i], trigger_cnt++);
+        }
+        if (write_all(fd, buffer, n * sizeof(struct single_pass_data)) != 0)
+            break;
+        sent += n;
+        // a burst takes the time of all its triggers
+        if (period > 0)
+        {
+            next += n * period;
+            sleep_until(next);
+        }
+    }
+    return sent;
+}
+
+// replay a captured file with the timing of its time stamps
+static uint64_t replay(int fd)
+{
+    struct single_pass_data rec;
+    uint64_t sent = 0;
+    FILE *in = fopen(replay_file, "rb");
+    if (in == NULL)
+    {
+        perror("streamgen : replay file");
+        return 0;
+    }
+    uint64_t start = now_ns(CLOCK_MONOTONIC);
+    uint64_t first = 0;
+    while (running && ((count == 0) || (sent < count)))
+    {
+        if (fread(&rec, sizeof(rec), 1, in) != 1)
+        {
+            if (!replay_loop || (sent == 0))
+                break;
+            // start over with the timing of the next pass
+            rewind(in);
+            start = now_ns(CLOCK_MONOTONIC);
+            first = 0;
+            continue;
+        }
+        if ((replay_speed > 0.0) && (rec.time != 0))
+        {
+            if (first == 0)
+                first = rec.time;
+            if (rec.time > first)
+                sleep_until(start + (uint64_t)((rec.time - first) / replay_speed));
+        }
+        if (restamp)
+            rec.time = now_ns(CLOCK_REALTIME);
+        if (write_all(fd, &rec, sizeof(rec)) != 0)
+            break;
+        sent++;
+    }
+    fclose(in);
+    return sent;
+}
+
+// print the options and exit
+static void usage()
+{
+    fprintf(stderr,
+        "usage: streamgen [options] output\n"
+        "  output       file or FIFO to write, - for stdout\n"
+        "  -u           serve the records on a unix socket at the output path\n"
+        "  -r rate      trigger rate [Hz] (default 1000), 0 for as fast as possible\n"
+        "  -n count     number of records, 0 (default) for an infinite stream\n"
+        "  -b burst     number of records written together (default 1)\n"
+        "  -x pos       mean horizontal position [mm] (default 0)\n"
+        "  -y pos       mean vertical position [mm] (default 0)\n"
+        "  -s sigma     RMS position noise [mm] (default 0.01)\n"
+        "  -a sum       mean sum of the button amplitudes (default 100000)\n"
+        "  -A sigma     RMS relative noise of the sum (default 0.01)\n"
+        "  -g prob      probability of a gap in the trigger counter per record (default 0)\n"
+        "  -G max       maximum number of missing triggers of a gap (default 10)\n"
+        "  -p file      replay the records of a captured file instead of synthesizing them\n"
+        "  -t factor    replay speed relative to the recorded time stamps (default 1),\n"
+        "               0 for as fast as possible, ignored without -p\n"
+        "  -T           replace the time stamps of replayed records by the current time\n"
+        "  -l           replay the file in an endless loop\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "ur:n:b:x:y:s:a:A:g:G:p:t:Tl")) != -1)
+    {
+        switch (opt)
+        {
+            case 'u' : unix_socket = true; break;
+            case 'r' : rate = atof(optarg); break;
+            case 'n' : count = strtoull(optarg, NULL, 0); break;
+            case 'b' : burst = atoi(optarg); break;
+            case 'x' : pos_x = atof(optarg); break;
+            case 'y' : pos_y = atof(optarg); break;
+            case 's' : pos_sigma = atof(optarg); break;
+            case 'a' : sum_mean = atof(optarg); break;
+            case 'A' : sum_sigma = atof(optarg); break;
+            case 'g' : gap_prob = atof(optarg); break;
+            case 'G' : gap_max = atoi(optarg); break;
+            case 'p' : replay_file = optarg; break;
+            case 't' : replay_speed = atof(optarg); break;
+            case 'T' : restamp = true; break;
+            case 'l' : replay_loop = true; break;
+            default :
+                usage();
+        }
+    }
+    if (optind != argc-1)
+        usage();
+    if ((burst < 1) || (burst > MAX_BURST))
+        Die("burst out of range");
+    if ((rate < 0.0) || (replay_speed < 0.0))
+        Die("rate and replay speed must not be negative");
+    if (gap_max < 1)
+        Die("maximum gap must be at least 1");
+
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+    // a closed reader ends the program
+    signal(SIGPIPE, SIG_IGN);
+
+    // opening a FIFO waits for the reader
+    int fd = open_output(argv[optind]);
+    if (fd < 0)
+        Die("failed to open the output");
+
+    uint64_t start = now_ns(CLOCK_MONOTONIC);
+    uint64_t sent = (replay_file != NULL) ? replay(fd) : generate(fd);
+    double elapsed = (now_ns(CLOCK_MONOTONIC) - start) * 1.e-9;
+    fprintf(stderr, "streamgen : %llu records in %.3f s (%.0f records/s)\n",
+        (unsigned long long)sent, elapsed, (elapsed > 0.0) ? sent / elapsed : 0.0);
+
+    if (fd != STDOUT_FILENO)
+        close(fd);
+    return 0;
+}